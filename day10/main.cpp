@@ -4,14 +4,79 @@
 #include <filesystem>
 #include <vector>
 #include <algorithm>
-#include <numeric>
+#include <map>
 
 const std::string INPUT_FILENAME = "input.txt";
 
+// Set of joltages as a presence bitmap: bit j is set if there's an
+// adaptor (or the outlet, or the device) rated j jolts. Joltages are
+// small, so inserting while parsing gives us the sorted, deduplicated
+// set in O(n + range) with no sort needed afterwards.
+class JoltageSet
+{
+public:
+    void Insert(int Joltage)
+    {
+        if (Joltage < 0) throw("Negative joltage");
+
+        size_t Word = Joltage / 64;
+        if (Word >= Bits.size()) Bits.resize(Word + 1, 0);
+        Bits[Word] |= 1ull << (Joltage % 64);
+        Highest = std::max(Highest, Joltage);
+    }
+
+    bool Contains(int Joltage) const
+    {
+        return Joltage >= 0 && (size_t)Joltage / 64 < Bits.size() && (Bits[Joltage / 64] >> (Joltage % 64) & 1);
+    }
+
+    int Max() const { return Highest; }
+
+    const std::vector<uint64_t>& Words() const { return Bits; }
+
+    // First joltage at or above From that is in the set (or not in the
+    // set), or one past Max if there isn't one.
+    int NextSet(int From) const { return NextMatching(From, 0); }
+    int NextClear(int From) const { return NextMatching(From, ~0ull); }
+
+    // Call Visit with each joltage in ascending order, skipping over
+    // empty stretches a word at a time.
+    template <typename Fn>
+    void ForEach(Fn Visit) const
+    {
+        for (size_t Word = 0; Word < Bits.size(); Word++)
+        {
+            for (uint64_t Remaining = Bits[Word]; Remaining != 0; Remaining &= Remaining - 1)
+            {
+                Visit((int)(Word * 64 + __builtin_ctzll(Remaining)));
+            }
+        }
+    }
+
+private:
+    std::vector<uint64_t> Bits;
+    int Highest = -1;
+
+    // Scan for the first bit that differs from Flip, a word at a time.
+    int NextMatching(int From, uint64_t Flip) const
+    {
+        size_t Word = From / 64;
+        if (Word >= Bits.size()) return Highest + 1;
+
+        uint64_t Remaining = (Bits[Word] ^ Flip) & (~0ull << (From % 64));
+        while (Remaining == 0)
+        {
+            if (++Word >= Bits.size()) return std::min<int>(Word * 64, Highest + 1);
+            Remaining = Bits[Word] ^ Flip;
+        }
+        return std::min<int>(Word * 64 + __builtin_ctzll(Remaining), Highest + 1);
+    }
+};
+
 // This isn't great but TIL you can't use a capturing lambda
 // as a function pointer, so I can't use the lambda method below
 // with a local variable.
-std::vector<int> AdaptorJoltages;
+JoltageSet AdaptorJoltages;
 
 void ReadInput(void (*function)(std::string))
 {
@@ -32,148 +97,236 @@ void ReadInput(void (*function)(std::string))
     }
 }
 
-void partOne()
+// Everything about the gaps in the full chain of adaptors, worked out in a
+// single pass and shared by both parts.
+struct ChainAnalysis
+{
+    // Number of gaps of each size from 1 to MaxStep
+    std::vector<uint64_t> GapCounts;
+
+    // Gaps too big to bridge (size -> count). Any of these breaks the chain.
+    std::map<int, uint64_t> BrokenGaps;
+
+    // Runs of consecutive 1 Jolt gaps (number of gaps in the run -> count)
+    std::map<int, uint64_t> OneJoltRuns;
+
+    bool Valid() const { return BrokenGaps.empty(); }
+
+    uint64_t Count(int Gap) const
+    {
+        if (Gap > 0 && Gap < (int)GapCounts.size()) return GapCounts[Gap];
+        return BrokenGaps.count(Gap) == 1 ? BrokenGaps.at(Gap) : 0;
+    }
+};
+
+// The same analysis one joltage at a time, for steps too big for the
+// word-at-a-time version below.
+ChainAnalysis analyseChainScalar(const JoltageSet& Joltages, int MaxStep)
+{
+    ChainAnalysis Analysis;
+    Analysis.GapCounts.assign(MaxStep + 1, 0);
+
+    int Previous = -1;
+    int OneJoltRun = 0;
+    Joltages.ForEach([&](int Joltage) {
+        if (Previous >= 0)
+        {
+            int Gap = Joltage - Previous;
+            if (Gap <= MaxStep) Analysis.GapCounts[Gap]++;
+            else Analysis.BrokenGaps[Gap]++;
+
+            if (Gap == 1) OneJoltRun++;
+            else if (OneJoltRun > 0)
+            {
+                Analysis.OneJoltRuns[OneJoltRun]++;
+                OneJoltRun = 0;
+            }
+        }
+        Previous = Joltage;
+    });
+    if (OneJoltRun > 0) Analysis.OneJoltRuns[OneJoltRun]++;
+
+    return Analysis;
+}
+
+// Analyse the chain 64 joltages at a time using the bitmap words. With B
+// being the set of joltages, B & (B >> k) has a bit set for every pair of
+// adaptors k jolts apart, and masking out the ones with anything between
+// them leaves exactly the gaps of size k, so each gap size is one popcount
+// per word. Whatever is left with nothing within MaxStep above it is a
+// broken gap, and runs of 1 Jolt gaps are runs of consecutive set bits.
+// Shifts only go up to 63 bits, so bigger steps use the scalar version.
+ChainAnalysis analyseChain(const JoltageSet& Joltages, int MaxStep)
 {
-    int OneJoltDiffs = 0, ThreeJoltDiffs = 0;
+    if (MaxStep < 1) throw("Max step must be at least 1");
+    if (MaxStep > 63) return analyseChainScalar(Joltages, MaxStep);
+
+    ChainAnalysis Analysis;
+    Analysis.GapCounts.assign(MaxStep + 1, 0);
+    const auto& Words = Joltages.Words();
 
-    for (int i = 1; i < AdaptorJoltages.size(); i++)
+    // Word w shifted down by k bits, pulling in the bottom of the next word
+    auto Shifted = [&](size_t w, int k) {
+        uint64_t Next = (w + 1 < Words.size()) ? Words[w + 1] << (64 - k) : 0;
+        return (Words[w] >> k) | Next;
+    };
+
+    for (size_t w = 0; w < Words.size(); w++)
     {
-        int Difference = AdaptorJoltages[i] - AdaptorJoltages[i-1];
-        switch(Difference)
+        uint64_t B = Words[w];
+
+        // Joltages with nothing in the k-1 joltages above them
+        uint64_t Clear = ~0ull;
+        for (int k = 1; k <= MaxStep; k++)
+        {
+            uint64_t Above = Shifted(w, k);
+            Analysis.GapCounts[k] += __builtin_popcountll(B & Clear & Above);
+            Clear &= ~Above;
+        }
+
+        // Nothing within MaxStep above, apart from at the very top of the chain
+        uint64_t Broken = B & Clear;
+        if ((size_t)Joltages.Max() / 64 == w) Broken &= ~(1ull << (Joltages.Max() % 64));
+        for (; Broken != 0; Broken &= Broken - 1)
+        {
+            int Joltage = w * 64 + __builtin_ctzll(Broken);
+            Analysis.BrokenGaps[Joltages.NextSet(Joltage + 1) - Joltage]++;
+        }
+
+        // Starts of runs of consecutive joltages
+        uint64_t Below = (B << 1) | ((w > 0) ? Words[w - 1] >> 63 : 0);
+        for (uint64_t Starts = B & ~Below; Starts != 0; Starts &= Starts - 1)
         {
-            case 1:
-                OneJoltDiffs++;
-                break;
-            case 3:
-                ThreeJoltDiffs++;
-                break;
+            int Start = w * 64 + __builtin_ctzll(Starts);
+            int Gaps = Joltages.NextClear(Start) - Start - 1;
+            if (Gaps > 0) Analysis.OneJoltRuns[Gaps]++;
         }
     }
 
+    return Analysis;
+}
+
+void partOne(const ChainAnalysis& Analysis)
+{
+    uint64_t OneJoltDiffs = Analysis.Count(1), ThreeJoltDiffs = Analysis.Count(3);
     std::cout << "Part 1 answer is " << OneJoltDiffs * ThreeJoltDiffs << std::endl;
 }
 
-int64_t CombinationsFromRange(int RangeStart, int RangeEnd)
+void printAnalysis(const ChainAnalysis& Analysis)
 {
-    // Number of adaptors is one higher than the difference of
-    // their positions.
-    int AdaptorCount = RangeEnd - RangeStart + 1;
+    std::cout << std::endl << "Gap size: count" << std::endl;
+    for (int Gap = 1; Gap < (int)Analysis.GapCounts.size(); Gap++)
+    {
+        std::cout << Gap << ": " << Analysis.GapCounts[Gap] << std::endl;
+    }
+    for (const auto& [Gap, Count] : Analysis.BrokenGaps)
+    {
+        std::cout << Gap << ": " << Count << " (too big, chain is broken)" << std::endl;
+    }
 
-    // See the huge comment below for the calculations.
-    switch(AdaptorCount)
+    std::cout << std::endl << "Run of 1 Jolt gaps: count" << std::endl;
+    for (const auto& [Length, Count] : Analysis.OneJoltRuns)
     {
-        case 2:
-            return 1;
-        case 3:
-            return 2;
-        case 4:
-            return 4;
-        default:
-            return 4 + 3 * (AdaptorCount - 4);
+        std::cout << Length << ": " << Count << std::endl;
     }
 }
 
-void partTwo()
+// Count the ways of getting from the lowest joltage to the highest, where
+// each adaptor can take an input between 1 and MaxStep jolts lower than its
+// rating. This is a DP over the joltages: the number of ways to reach an
+// adaptor is the sum of the ways to reach every adaptor in the MaxStep
+// joltages below it. Walking the bitmap in joltage order with a running sum
+// of the last MaxStep values keeps it O(range) for any MaxStep and any mix
+// of gaps (a gap bigger than MaxStep just gives zero ways), and only needs
+// MaxStep values of memory.
+//
+// The counts grow exponentially with the number of adaptors, so with a
+// Modulus of 0 the result is exact and overflow throws, otherwise the
+// result is the count modulo Modulus.
+uint64_t countArrangements(const JoltageSet& Joltages, int MaxStep, uint64_t Modulus)
 {
-    // Here we need to find all of the different combinations of adaptors that are
-    // possible to get an unbroken chain from the outlet (0) to the device (highest
-    // adaptor + 3) in various combination, WITH OR WITHOUT USING ALL ADAPTORS.
-    //
-    // Brute force is an undesirable option.
-    //
-    // We can skip the 3 Jolt gaps because these are non-negotiable - there's only
-    // one combination of adaptors possible so only 1 variation. Similarly, either
-    // by accident or design, we have no 2 Jolt gaps in the input data so we only
-    // need to consider the 1 Jolt gaps.
-    //
-    // Maximum difference between adaptors can be 3 Jolts. We could have 1, 2, 3, 4
-    // or more adaptors, but given the 3 Jolt limitation, there is a distinct number
-    // of possible combinations only up to 4 adaptors. Then we just add another 3
-    // possible connections (and thus combinations) for every additional adaptor with
-    // a 1 Jolt difference.
-    //
-    // 2 adaptors = 1 combination (e.g. 0 -> 1)
-    // 3 adaptors = 2 combinations (e.g. 0 -> 1 -> 2, 0 -> 2)
-    // 4 adaptors = 4 combinations (0, 1, 2, 3) not going to bother mapping these out...
-    // 5 adaptors = 7 combinations (0-4, 3 more than last time)
-    //
-    // So we only need to consider the distinct cases of 2 and 3, and for every
-    // additional adaptor we add 3 more combinations.
-    // Once we've figured this out for each unbroken chain of 1 Jolt differences,
-    // we can multiply them all together to give the answer of how many combinations
-    // there are amongst all adaptors (hopefully).
-    // Complexity should be O(n).
-
-    std::vector<int64_t> Combinations;
-
-    int RangeStart = 0;
-    int RangeEnd = 0;
-    bool InRange = false;
-
-    for (int i = 1; i < AdaptorJoltages.size(); i++)
-    {
-        // Current gap is 1, start or continue a range.
-        if (AdaptorJoltages[i] - AdaptorJoltages[i-1] == 1)
-        {
-            // whether or not we are already in a range, update
-            // the endpoint to be the current element
-            RangeEnd = i;
+    int Lowest = -1;
+    Joltages.ForEach([&](int Joltage) { if (Lowest < 0) Lowest = Joltage; });
+    if (Lowest < 0) return 0;
 
-            // start the range and loop around
-            if (!InRange)
-            {
-                InRange = true;
-                RangeStart = i - 1;
-            }
+    auto Add = [Modulus](uint64_t a, uint64_t b) {
+        if (Modulus != 0) return (a % Modulus + b % Modulus) % Modulus;
 
-            // If this is the final element, push the range so
-            // we don't lose it.
-            if (i == AdaptorJoltages.size() - 1)
-            {
-                Combinations.push_back(CombinationsFromRange(RangeStart, RangeEnd));
-            }
+        uint64_t Sum;
+        if (__builtin_add_overflow(a, b, &Sum)) throw("Arrangement count overflowed 64 bits, use a modulus");
+        return Sum;
+    };
+    auto Subtract = [Modulus](uint64_t a, uint64_t b) {
+        return (Modulus != 0) ? (a + Modulus - b % Modulus) % Modulus : a - b;
+    };
 
-            // nothing left to do until the range is ended
-            continue;
-        }
+    // Ways to reach each of the last MaxStep joltages, indexed by joltage
+    // modulo MaxStep, and their sum.
+    std::vector<uint64_t> Recent(MaxStep, 0);
+    uint64_t WindowSum = 0;
+    uint64_t Ways = 0;
 
-        // Assume here we saw a diff of 3.
-        // Either end the previous range if one was in flight, or
-        // keep on going.
-        if (InRange)
-        {
-            // close off the range and add the combinations
-            InRange = false;
-            Combinations.push_back(CombinationsFromRange(RangeStart, RangeEnd));
-        }
+    for (int Joltage = Lowest; Joltage <= Joltages.Max(); Joltage++)
+    {
+        if (Joltage == Lowest) Ways = 1;
+        else Ways = Joltages.Contains(Joltage) ? WindowSum : 0;
+
+        uint64_t& Oldest = Recent[Joltage % MaxStep];
+        WindowSum = Add(Subtract(WindowSum, Oldest), Ways);
+        Oldest = Ways;
     }
 
-    // hey look functional programming!
-    int64_t TotalCombinations = std::accumulate(
-        Combinations.begin(),
-        Combinations.end(),
-        (int64_t)1, // INITIAL VALUE MUST BE THE RIGHT TYPE!!!!
-        std::multiplies<int64_t>()
-    );
+    return Ways;
+}
+
+void partTwo(const ChainAnalysis& Analysis, int MaxStep, uint64_t Modulus)
+{
+    // Here we need to find all of the different combinations of adaptors that are
+    // possible to get an unbroken chain from the outlet (0) to the device (highest
+    // adaptor + 3) in various combination, WITH OR WITHOUT USING ALL ADAPTORS.
+    // This used to be worked out from the lengths of runs of 1 Jolt gaps, which
+    // only worked for short runs and no 2 Jolt gaps. Counting paths directly
+    // works for any input. There's no point counting if the chain is broken.
+    uint64_t TotalCombinations = Analysis.Valid() ? countArrangements(AdaptorJoltages, MaxStep, Modulus) : 0;
 
-    std::cout << "Total number of possible combinations of adaptors: " << TotalCombinations << std::endl;
+    std::cout << "Total number of possible combinations of adaptors: " << TotalCombinations;
+    if (Modulus != 0) std::cout << " (mod " << Modulus << ")";
+    std::cout << std::endl;
 }
 
 int main(int argc, char** argv)
 {
-    // Put the outlet joltage in the list so we can generate a difference
+    // The biggest allowed step between adaptors, and an optional modulus
+    // for the arrangement count, can be given as --max-step N --modulus M.
+    // --analyse prints the full gap histogram as well.
+    int MaxStep = 3;
+    uint64_t Modulus = 0;
+    bool PrintAnalysis = false;
+    for (int i = 1; i < argc; i++)
+    {
+        std::string Flag = argv[i];
+        if (Flag == "--max-step" && i + 1 < argc) MaxStep = std::stoi(argv[++i]);
+        if (Flag == "--modulus" && i + 1 < argc) Modulus = std::stoull(argv[++i]);
+        if (Flag == "--analyse") PrintAnalysis = true;
+    }
+
+    // Put the outlet joltage in the set so we can generate a difference
     // to that like all the other adaptors.
-    AdaptorJoltages.push_back(0);
+    AdaptorJoltages.Insert(0);
 
-    // Read and sort adaptors by joltage
-    ReadInput([](std::string Line) { AdaptorJoltages.push_back(std::stoi(Line)); });
-    std::sort(AdaptorJoltages.begin(), AdaptorJoltages.end());
+    // Read adaptors straight into the (always sorted) set
+    ReadInput([](std::string Line) {
+        if (!Line.empty()) AdaptorJoltages.Insert(std::stoi(Line));
+    });
 
-    // Highest device rating is the highest jolt adaptor + 3
-    // Push this to the end so we have a final difference to calculate.
-    int DeviceRating = AdaptorJoltages.back() + 3;
-    AdaptorJoltages.push_back(DeviceRating);
+    // Highest device rating is the highest jolt adaptor + 3 (or whatever
+    // the biggest step is). Add this at the end so we have a final
+    // difference to calculate.
+    int DeviceRating = AdaptorJoltages.Max() + MaxStep;
+    AdaptorJoltages.Insert(DeviceRating);
 
-    partOne();
-    partTwo();
+    ChainAnalysis Analysis = analyseChain(AdaptorJoltages, MaxStep);
+    partOne(Analysis);
+    partTwo(Analysis, MaxStep, Modulus);
+    if (PrintAnalysis) printAnalysis(Analysis);
 }
\ No newline at end of file
@@ -4,307 +4,902 @@
 #include <filesystem>
 #include <numeric>
 #include <vector>
+#include <functional>
+#include <random>
+#include <chrono>
+#include <climits>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <algorithm>
 
 const std::string INPUT_FILENAME = "input.txt";
 
-// Add two cells in either dimension to make boundary checking easier.
-// I'm having trouble figuring out if the input file is actually 98x98 or 99x99.
-const int DIM = 101;
+void ReadInput(std::function<void(std::string)> function)
+{
+    std::ifstream ifs;
+    ifs.open(INPUT_FILENAME);
 
-enum class Direction
+    if (ifs.fail())
+    {
+        std::cout << std::filesystem::current_path() << std::endl;
+        throw("Failed to open input file");
+    }
+
+    while (!ifs.eof())
+    {
+        std::string Line;
+        std::getline(ifs, Line);
+        function(Line);
+    }
+}
+
+// The characters from the puzzle
+struct SeatAlphabet
 {
-    N, NE, E, SE, S, SW, W, NW
+    static constexpr char Floor = '.';
+    static constexpr char Empty = 'L';
+    static constexpr char Occupied = '#';
 };
 
-class Layout
+// The seating map with one cell of padding all the way round, so looking
+// one step in any direction from a cell never leaves the grid. The grid is
+// as big as the input, and seats are numbered in reading order.
+struct PaddedSeatMap
 {
-public:
-    Layout() {
-        // Initialize both storages
-        for (int i = 0; i < DIM*DIM; i++)
+    int Width = 0;
+    int Height = 0;
+    int Stride = 0;
+
+    // seat number of each cell (-1 for floor and padding), and the cell of
+    // each seat
+    std::vector<int> SeatAt;
+    std::vector<int> Seats;
+
+    // whether each seat starts out occupied
+    std::vector<uint8_t> Occupied;
+
+    bool IsPadding(int Cell) const
+    {
+        int x = Cell % Stride, y = Cell / Stride;
+        return x == 0 || y == 0 || x == Width + 1 || y == Height + 1;
+    }
+};
+
+// Lines can be ragged, so the grid has to be as wide as the longest one
+int LongestLine(const std::vector<std::string>& Lines)
+{
+    int Longest = 0;
+    for (auto& Line : Lines) Longest = std::max(Longest, (int)Line.size());
+    return Longest;
+}
+
+template <typename Alphabet = SeatAlphabet>
+PaddedSeatMap ParseSeatMap(const std::vector<std::string>& Lines)
+{
+    PaddedSeatMap Map;
+    Map.Height = Lines.size();
+    Map.Width = LongestLine(Lines);
+    Map.Stride = Map.Width + 2;
+    Map.SeatAt.assign(Map.Stride * (Map.Height + 2), -1);
+
+    for (int y = 0; y < Map.Height; y++)
+    {
+        for (int x = 0; x < (int)Lines[y].size(); x++)
         {
-            StorageA.push_back('\0');
-            StorageB.push_back('\0');
+            char c = Lines[y][x];
+            if (c == Alphabet::Floor) continue;
+            if (c != Alphabet::Empty && c != Alphabet::Occupied) throw("Unexpected character in seating map");
+
+            int Cell = (y + 1) * Map.Stride + x + 1;
+            Map.SeatAt[Cell] = Map.Seats.size();
+            Map.Seats.push_back(Cell);
+            Map.Occupied.push_back(c == Alphabet::Occupied);
         }
-
-        CurrentStorage = &StorageA;
-        NewStorage = &StorageB;
     }
+    return Map;
+}
+
+// N, NE, E, SE, S, SW, W, NW as (x, y) steps
+const int NEIGHBOUR_DIRECTIONS[8][2] = {{0, -1}, {1, -1}, {1, 0}, {1, 1}, {0, 1}, {-1, 1}, {-1, 0}, {-1, -1}};
+const int NO_SEAT = -1;
+
+// Work out the neighbours of every seat once, since seats never move and
+// only their occupancy changes. Gives 8 seat numbers per seat, one per
+// direction, or NO_SEAT. With LineOfSight the neighbours are the first
+// seats visible in each direction (part 2), otherwise only immediately
+// adjacent seats (part 1).
+//
+// For each direction, FirstSeat[cell] is the first seat found looking that
+// way starting at (and including) the cell. Cells are stored in reading
+// order, so going through them backwards for directions with a positive
+// offset (and forwards otherwise) means each cell only has to look one
+// step ahead, and the whole thing is O(cells) per direction.
+std::vector<int> FindNeighbourSeats(const PaddedSeatMap& Map, bool LineOfSight)
+{
+    int Cells = Map.SeatAt.size();
+    std::vector<int> Neighbours(Map.Seats.size() * 8);
+    std::vector<int> FirstSeat(Cells);
 
-    // Only count the neighbours in the immediately surrounding 8 positions
-    int CountNeighbours(int x, int y)
+    for (int d = 0; d < 8; d++)
     {
-        // Indexes in the current storage to the surrounding 8
-        // positions around the given location.
-        std::vector<int> Indices = {
-            (y-1)*DIM + x - 1,
-            (y-1)*DIM + x,
-            (y-1)*DIM + x + 1,
-            y*DIM + x - 1,
-            y*DIM + x + 1,
-            (y+1)*DIM + x - 1,
-            (y+1)*DIM + x,
-            (y+1)*DIM + x + 1
-        };
+        int Offset = NEIGHBOUR_DIRECTIONS[d][1] * Map.Stride + NEIGHBOUR_DIRECTIONS[d][0];
+        for (int i = 0; i < Cells; i++)
+        {
+            int Cell = (Offset > 0) ? Cells - 1 - i : i;
+            bool LookFurther = LineOfSight && Map.SeatAt[Cell] == NO_SEAT && !Map.IsPadding(Cell);
+            FirstSeat[Cell] = LookFurther ? FirstSeat[Cell + Offset] : Map.SeatAt[Cell];
+        }
 
-        // Was previously using std::accumulate here but I think it was a bit
-        // too clever and didn't return the right thing. The following is less
-        // code anyway.
-        int Neighbours = 0;
-        for (auto Index : Indices)
+        for (int Seat = 0; Seat < (int)Map.Seats.size(); Seat++) Neighbours[Seat * 8 + d] = FirstSeat[Map.Seats[Seat] + Offset];
+    }
+    return Neighbours;
+}
+
+// Part 1 seating with one bit per cell, 64 cells to a word. Each row is
+// stored as a run of words with an empty row above and below the grid, so
+// neighbour rows never need bounds checks. To count neighbours, the eight
+// neighbour bitmasks of a word (the rows above and below, each shifted
+// left and right) are added together bit-sliced: four words hold the four
+// bits of the count for all 64 cells at once, so a generation is a few
+// dozen bitwise operations per 64 cells.
+class BitboardLayout
+{
+public:
+    BitboardLayout(const std::vector<std::string>& Lines)
+        : Height(Lines.size()),
+          Width(LongestLine(Lines)),
+          RowWords((Width + 63) / 64),
+          Seats((Height + 2) * RowWords, 0),
+          Occupied((Height + 2) * RowWords, 0),
+          Next((Height + 2) * RowWords, 0)
+    {
+        for (int y = 0; y < Height; y++)
         {
-            if ((*CurrentStorage)[Index] == '#') Neighbours++;
+            for (int x = 0; x < (int)Lines[y].size(); x++)
+            {
+                uint64_t Bit = 1ull << (x % 64);
+                size_t Index = (y + 1) * RowWords + x / 64;
+                if (Lines[y][x] != '.') Seats[Index] |= Bit;
+                if (Lines[y][x] == '#') Occupied[Index] |= Bit;
+            }
         }
-        return Neighbours;
     }
 
-    // Count the visible neighbours in the surrounding 8 directions, irrespective of
-    // distance. If an empty chair is visible first, don't examine further.
-    int CountVisibleNeighbours(int x, int y)
+    // Run one generation with the part 1 rules, returning whether anything changed.
+    bool Step()
     {
-        std::vector<Direction> Directions = {
-            Direction::N, Direction::NE, Direction::E, Direction::SE,
-            Direction::S, Direction::SW, Direction::W, Direction::NW
-        };
+        bool Changed = false;
 
-        int Count = 0;
-        for (auto d : Directions)
+        for (int y = 1; y <= Height; y++)
         {
-            if (SeeNeighboursInDirection(x, y, d)) Count++;
+            for (int w = 0; w < RowWords; w++)
+            {
+                // bit-sliced neighbour count, one bit of the count per word
+                uint64_t Count0 = 0, Count1 = 0, Count2 = 0, Count3 = 0;
+                auto Add = [&](uint64_t Neighbours) {
+                    uint64_t Carry0 = Count0 & Neighbours;
+                    Count0 ^= Neighbours;
+                    uint64_t Carry1 = Count1 & Carry0;
+                    Count1 ^= Carry0;
+                    uint64_t Carry2 = Count2 & Carry1;
+                    Count2 ^= Carry1;
+                    Count3 |= Carry2;
+                };
+
+                for (int dy = -1; dy <= 1; dy++)
+                {
+                    size_t Row = (y + dy) * RowWords;
+                    uint64_t Word = Occupied[Row + w];
+                    uint64_t Before = (w > 0) ? Occupied[Row + w - 1] : 0;
+                    uint64_t After = (w + 1 < RowWords) ? Occupied[Row + w + 1] : 0;
+
+                    // the cells to the left and right of each cell, lined up with it
+                    Add((Word << 1) | (Before >> 63));
+                    Add((Word >> 1) | (After << 63));
+                    if (dy != 0) Add(Word);
+                }
+
+                size_t Index = y * RowWords + w;
+                uint64_t Current = Occupied[Index];
+                uint64_t NoNeighbours = ~(Count0 | Count1 | Count2 | Count3);
+                uint64_t FourOrMore = Count2 | Count3;
+
+                // Empty seats with no neighbours fill, filled seats with four
+                // or more neighbours empty, everything else stays the same.
+                Next[Index] = Seats[Index] & ((~Current & NoNeighbours) | (Current & ~FourOrMore));
+                Changed |= Next[Index] != Current;
+            }
         }
 
+        std::swap(Occupied, Next);
+        return Changed;
+    }
+
+    int OccupiedSeatsCount() const
+    {
+        int Count = 0;
+        for (uint64_t Word : Occupied) Count += __builtin_popcountll(Word);
         return Count;
     }
 
-    // convenience functions
-    // should really check for '.' but I suspect something funky is going on with
-    // boundary cells.
-    bool IsFloor(int x, int y) const { return Get(x, y) != '#' && Get(x, y) != 'L'; };
-    bool IsFilled(int x, int y) const { return Get(x, y) == '#'; };
-    
-    void Fill(int x, int y) { Set(x, y, '#'); };
-    void Empty(int x, int y) { Set(x, y, 'L'); };
+private:
+    int Height;
+    int Width;
+    int RowWords;
+
+    std::vector<uint64_t> Seats;
+    std::vector<uint64_t> Occupied;
+    std::vector<uint64_t> Next;
+};
+
+// Run the bitboard simulation until it stabilises, returning the number of
+// generations (including the last one, which made no changes). Not every
+// layout stabilises (some end up flipping back and forth forever) so give
+// up after running MaxIterations generations. All of the engines count
+// this way, so a capped run does the same amount of work in each.
+int RunBitboardSimulation(BitboardLayout& Ferry, int MaxIterations = INT_MAX)
+{
+    int Iterations = 1;
+    while (Ferry.Step() && Iterations < MaxIterations) Iterations++;
+    return Iterations;
+}
+
+// Above SeatCount / this many candidates StepActive scans every seat.
+const int ACTIVE_SET_DENSE_FRACTION = 4;
 
-    // end the current simulation iteration and swap active storage
-    void Commit()
+// The seats and who can see whom, with floor not stored at all. Each seat
+// has exactly 8 neighbour slots in one flat array, from FindNeighbourSeats.
+// Directions with no seat point at an extra dummy seat that is never
+// occupied, so the simulation can add up all 8 without any checks.
+class SeatGraph
+{
+public:
+    // See FindNeighbourSeats for what LineOfSight does
+    SeatGraph(const std::vector<std::string>& Lines, bool LineOfSight)
     {
-        std::swap(CurrentStorage, NewStorage);
+        PaddedSeatMap Map = ParseSeatMap(Lines);
+        SeatCount = Map.Seats.size();
+
+        // seats are numbered in reading order, so each row's seats follow
+        // on from the ones in the rows above
+        RowStarts.assign(Map.Height + 1, 0);
+        for (int Cell : Map.Seats) RowStarts[Cell / Map.Stride]++;
+        std::partial_sum(RowStarts.begin(), RowStarts.end(), RowStarts.begin());
+
+        Occupied = Map.Occupied;
+        Occupied.push_back(0); // the dummy seat
+        Next = Occupied;
 
-        // copy current storage to new storage so that they
-        // are now mirrored for the next set of operations
-        for (int i = 0; i < (*CurrentStorage).size(); i++)
+        Neighbours = FindNeighbourSeats(Map, LineOfSight);
+        for (int& Seat : Neighbours)
         {
-            (*NewStorage)[i] = (*CurrentStorage)[i];
+            if (Seat == NO_SEAT) Seat = SeatCount;
         }
+
+        // The dummy seat is permanently marked as queued so StepActive
+        // never picks it up as a candidate.
+        Queued.assign(SeatCount + 1, 0);
+        Queued[SeatCount] = 1;
+    }
+
+    // Run one generation, returning whether anything changed.
+    bool Step(int Tolerance)
+    {
+        bool Changed = StepSeats(Tolerance, 0, SeatCount);
+        Swap();
+        return Changed;
     }
 
-    // Set a given cell's contents directly - normally only used by convenience
-    // functions or during input reading.
-    void Set(const int x, const int y, const char value)
+    // The two halves of Step, for running a generation in pieces: work out
+    // the next state of seats [First, Last) without touching the current
+    // state, then once every piece is done swap the buffers over.
+    bool StepSeats(int Tolerance, int First, int Last)
     {
-        // don't allow setting the outside rows/columns
-        assert(x > 0 && x < DIM);
-        assert(y > 0 && y < DIM);
+        bool Changed = false;
+        for (int Seat = First; Seat < Last; Seat++)
+        {
+            Next[Seat] = NextState(Seat, Tolerance);
+            Changed |= Next[Seat] != Occupied[Seat];
+        }
+        return Changed;
+    }
 
-        // This has to set the new value in the new storage
-        // to ensure the simulation is consistent across all cells.
-        (*NewStorage)[y*DIM + x] = value;
+    void Swap()
+    {
+        std::swap(Occupied, Next);
+        FullScanNeeded = true;
     }
 
-    // debugging
-    void PrintLayout() const
+    // Seats are numbered in reading order, so each row is a run of them
+    int Height() const { return RowStarts.size() - 1; }
+    int FirstSeatInRow(int Row) const { return RowStarts[Row]; }
+
+    // Same as Step, but only looks at seats that could possibly change: a
+    // seat's next state only depends on itself and its neighbours, so if
+    // none of those changed last generation it won't change now. Seeing
+    // each other is symmetric for both rule sets, so the candidates are
+    // just the seats that flipped plus their neighbours. Once most of the
+    // ferry has settled each generation costs about the size of the
+    // changing frontier rather than the whole map.
+    bool StepActive(int Tolerance)
     {
-        for (int y = 1; y < DIM-1; y++)
+        // While a big chunk of the ferry is still changing, keeping lists
+        // costs more than just going through every seat in order, so do a
+        // normal double-buffered generation and only build the candidate
+        // list once things have calmed down.
+        if (FullScanNeeded || (int)Candidates.size() > SeatCount / ACTIVE_SET_DENSE_FRACTION)
         {
-            for (int x = 1; x < DIM-1; x++)
+            int Changes = 0;
+            for (int Seat = 0; Seat < SeatCount; Seat++)
             {
-                std::cout << (*CurrentStorage)[y*DIM+x];
+                Queued[Seat] = 0;
+                Next[Seat] = NextState(Seat, Tolerance);
+                Changes += Next[Seat] != Occupied[Seat];
             }
-            std::cout << std::endl;
+            std::swap(Occupied, Next);
+
+            Candidates.clear();
+            FullScanNeeded = Changes > SeatCount / ACTIVE_SET_DENSE_FRACTION;
+            if (!FullScanNeeded)
+            {
+                for (int Seat = 0; Seat < SeatCount; Seat++)
+                {
+                    if (Occupied[Seat] != Next[Seat]) QueueAround(Seat);
+                }
+            }
+            return Changes > 0;
         }
-        std::cout << std::endl;
+
+        Flipped.clear();
+        for (int Seat : Candidates)
+        {
+            Queued[Seat] = 0;
+            if (NextState(Seat, Tolerance) != Occupied[Seat]) Flipped.push_back(Seat);
+        }
+
+        // Flip the changed seats in place only after everything has been
+        // evaluated, so the list of flips acts as the second buffer. This
+        // leaves Next out of date, but the dense pass rewrites all of it.
+        for (int Seat : Flipped) Occupied[Seat] ^= 1;
+
+        Candidates.clear();
+        for (int Seat : Flipped) QueueAround(Seat);
+        return !Flipped.empty();
     }
 
     int OccupiedSeatsCount() const
     {
-        int Count = 0;
-        for (auto c : (*CurrentStorage))
-        {
-            if (c == '#') Count++;
-        }
-        return Count;
+        return std::accumulate(Occupied.begin(), Occupied.begin() + SeatCount, 0);
     }
 
 private:
-    // Two vectors of DIM*DIM "cells" - one for the current
-    // layout, and the other for the next iteration.
-    // We swap between them on each iteration.
-    std::vector<char> StorageA;
-    std::vector<char> StorageB;
+    int SeatCount = 0;
 
-    // Pointers to the current layout and next layout
-    // so we can make consistent changes.
-    std::vector<char>* CurrentStorage;
-    std::vector<char>* NewStorage;
+    // occupancy of each seat plus the dummy seat at the end
+    std::vector<uint8_t> Occupied;
+    std::vector<uint8_t> Next;
 
-    char Get(int x, int y) const
+    // 8 neighbour seat indices per seat
+    std::vector<int> Neighbours;
+
+    // index of the first seat in each row, plus SeatCount at the end
+    std::vector<int> RowStarts;
+
+    // StepActive state: seats to evaluate this generation, seats that
+    // flipped, and which seats are already in the next candidate list.
+    // Any full Step invalidates the candidates.
+    std::vector<int> Candidates;
+    std::vector<int> Flipped;
+    std::vector<uint8_t> Queued;
+    bool FullScanNeeded = true;
+
+    // Add a changed seat and its neighbours to the next candidates
+    void QueueAround(int Seat)
     {
-        // don't allow setting the outside rows/columns
-        assert(x > 0 && x < DIM);
-        assert(y > 0 && y < DIM);
+        auto Enqueue = [this](int Other) {
+            if (Queued[Other]) return;
+            Queued[Other] = 1;
+            Candidates.push_back(Other);
+        };
+        Enqueue(Seat);
+        for (int d = 0; d < 8; d++) Enqueue(Neighbours[Seat * 8 + d]);
+    }
 
-        return (*CurrentStorage)[y*DIM + x];
+    // Filled seats with Tolerance or more neighbours empty, empty seats
+    // with none fill.
+    uint8_t NextState(int Seat, int Tolerance) const
+    {
+        const int* Around = &Neighbours[Seat * 8];
+        int Count = 0;
+        for (int d = 0; d < 8; d++) Count += Occupied[Around[d]];
+        return Occupied[Seat] ? (Count < Tolerance) : (Count == 0);
     }
+};
+
+// Counts generations the same way as RunBitboardSimulation
+int RunSeatGraphSimulation(SeatGraph& Ferry, int Tolerance, bool Active = false, int MaxIterations = INT_MAX)
+{
+    auto Step = [&]() { return Active ? Ferry.StepActive(Tolerance) : Ferry.Step(Tolerance); };
+
+    int Iterations = 1;
+    while (Step() && Iterations < MaxIterations) Iterations++;
+    return Iterations;
+}
 
-    bool SeeNeighboursInDirection(const int x, const int y, const Direction LookDirection)
+// Like std::barrier (which is C++20), except the last thread to arrive runs
+// Completion before anyone is let go.
+class Barrier
+{
+public:
+    Barrier(int Count) : Count(Count) {}
+
+    template <typename Fn>
+    void ArriveAndWait(Fn Completion)
     {
-        // "velocities" of travel
-        // in retrospect, this is a horrible way of doing it.
-        int xVel = 0, yVel = 0;
-        switch (LookDirection)
+        std::unique_lock<std::mutex> Lock(Mutex);
+        int Generation = CurrentGeneration;
+        if (++Arrived == Count)
         {
-            case Direction::N:
-                yVel = -1;
-                break;
-            case Direction::NW:
-                yVel = -1;
-                xVel = -1;
-                break; 
-            case Direction::NE:
-                yVel = -1;
-                xVel = 1;
-                break;
-            case Direction::S:
-                yVel = 1;
-                break;
-            case Direction::SW:
-                yVel = 1;
-                xVel = -1;
-                break;
-            case Direction::SE:
-                yVel = 1;
-                xVel = 1;
-                break;
-            case Direction::W:
-                xVel = -1;
-                break;
-            case Direction::E:
-                xVel = 1;
-                break;
+            Completion();
+            Arrived = 0;
+            CurrentGeneration++;
+            Lock.unlock();
+            Released.notify_all();
+            return;
         }
+        Released.wait(Lock, [&] { return Generation != CurrentGeneration; });
+    }
 
-        // iterate through layout in the view direction until we fall off
-        // or see an empty chair or neighbour
-        int currentX = x, currentY = y;
-        while (true)
-        {
-            currentX += xVel;
-            currentY += yVel;
+private:
+    std::mutex Mutex;
+    std::condition_variable Released;
+    int Count;
+    int Arrived = 0;
+    int CurrentGeneration = 0;
+};
+
+// Run a seat graph on several threads, each one owning a band of rows for
+// the whole simulation. The threads meet at a barrier after every
+// generation where the last one in swaps the buffers and combines
+// everyone's changed flag to decide whether to keep going. Bands are cut
+// so each has about the same number of seats rather than rows.
+int RunParallelSeatGraphSimulation(SeatGraph& Ferry, int Tolerance,
+                                   int ThreadCount = std::max(1u, std::thread::hardware_concurrency()),
+                                   int MaxIterations = INT_MAX)
+{
+    ThreadCount = std::max(1, std::min(ThreadCount, Ferry.Height()));
+
+    std::vector<int> BandStarts;
+    int SeatCount = Ferry.FirstSeatInRow(Ferry.Height());
+    for (int t = 0, Row = 0; t < ThreadCount; t++)
+    {
+        while (Row < Ferry.Height() && Ferry.FirstSeatInRow(Row) < (long)SeatCount * t / ThreadCount) Row++;
+        BandStarts.push_back(Ferry.FirstSeatInRow(Row));
+    }
+    BandStarts.push_back(SeatCount);
 
-            // bounds check
-            if (currentX <= 0 || currentX >= DIM - 1 || currentY <= 0 || currentY >= DIM - 1) return false;
+    // one changed flag per thread, each on its own cache line
+    struct alignas(64) BandResult { bool Changed = false; };
+    std::vector<BandResult> Results(ThreadCount);
 
-            char VisibleObject = Get(currentX, currentY);
+    Barrier EndOfGeneration(ThreadCount);
+    int Iterations = 1;
+    bool Done = false;
 
-            // see an empty chair, we don't care about what is beyond it
-            if (VisibleObject == 'L') return false;
-        
-            // see a neighbour
-            if (VisibleObject == '#') return true;
+    auto Completion = [&]() {
+        Ferry.Swap();
+
+        bool Changed = false;
+        for (auto& Result : Results) Changed |= Result.Changed;
+
+        // counted the same way as RunBitboardSimulation
+        if (!Changed || Iterations >= MaxIterations) Done = true;
+        else Iterations++;
+    };
+
+    auto Worker = [&](int t) {
+        while (!Done)
+        {
+            Results[t].Changed = Ferry.StepSeats(Tolerance, BandStarts[t], BandStarts[t + 1]);
+            EndOfGeneration.ArriveAndWait(Completion);
         }
+    };
+
+    std::vector<std::thread> Threads;
+    for (int t = 1; t < ThreadCount; t++) Threads.emplace_back(Worker, t);
+    Worker(0);
+    for (auto& Thread : Threads) Thread.join();
+
+    return Iterations;
+}
+
+// The seating simulation with the rules as template parameters, so the
+// compiler can build a separate tight loop for each rule set:
+//  - Neighbourhood decides which seats count as neighbours,
+//  - Rules decides when seats fill and empty,
+//  - Alphabet is the characters used in the map.
+// Occupancy is stored for every cell of the padded map. Padding and floor
+// are never occupied, so neighbours can be summed without checking what
+// they are.
+
+// Empty seats with at most MaxToFill neighbours fill, occupied seats with
+// at least MinToEmpty neighbours empty. The puzzle is <0, 4> then <0, 5>.
+template <int MaxToFill, int MinToEmpty>
+struct SeatRules
+{
+    static_assert(MaxToFill >= 0 && MinToEmpty <= 8, "Thresholds must be between 0 and 8 neighbours");
+
+    static uint8_t Next(uint8_t Filled, int Neighbours)
+    {
+        return Filled ? (Neighbours < MinToEmpty) : (Neighbours <= MaxToFill);
     }
 };
 
-void ReadInput(std::function<void(std::string)> function)
+// Neighbourhoods get built from the padded seat map. Count gets both the
+// seat's number and its cell, and uses whichever suits.
+
+// The 8 cells immediately around a seat (part 1)
+class AdjacentNeighbourhood
 {
-    std::ifstream ifs;
-    ifs.open(INPUT_FILENAME);
+public:
+    static constexpr const char* Name = "adjacent";
 
-    if (ifs.fail())
+    AdjacentNeighbourhood(const PaddedSeatMap& Map)
     {
-        std::cout << std::filesystem::current_path() << std::endl;
-        throw("Failed to open input file");
+        for (int d = 0; d < 8; d++) Offsets[d] = NEIGHBOUR_DIRECTIONS[d][1] * Map.Stride + NEIGHBOUR_DIRECTIONS[d][0];
     }
 
-    while (!ifs.eof())
+    int Count(const uint8_t* Occupied, int /* Seat */, int Cell) const
     {
-        std::string Line;
-        std::getline(ifs, Line);
-        function(Line);
+        int Neighbours = 0;
+        for (int d = 0; d < 8; d++) Neighbours += Occupied[Cell + Offsets[d]];
+        return Neighbours;
     }
-}
 
-int RunSimulation(Layout* Ferry, bool RelaxedRuleset = false)
+private:
+    int Offsets[8];
+};
+
+// The first seat visible in each of the 8 directions (part 2). Directions
+// with no seat point at cell 0, which is padding and so never occupied.
+class LineOfSightNeighbourhood
 {
-    int MaxNeighbourTolerance = RelaxedRuleset ? 5 : 4;
+public:
+    static constexpr const char* Name = "line of sight";
+
+    LineOfSightNeighbourhood(const PaddedSeatMap& Map)
+        : Visible(FindNeighbourSeats(Map, true))
+    {
+        for (int& Seen : Visible) Seen = (Seen == NO_SEAT) ? 0 : Map.Seats[Seen];
+    }
+
+    int Count(const uint8_t* Occupied, int Seat, int /* Cell */) const
+    {
+        const int* Around = &Visible[Seat * 8];
+        int Neighbours = 0;
+        for (int d = 0; d < 8; d++) Neighbours += Occupied[Around[d]];
+        return Neighbours;
+    }
+
+private:
+    // 8 cells per seat
+    std::vector<int> Visible;
+};
 
-    bool HaveMadeChanges = false;
+template <typename Neighbourhood, typename Rules, typename Alphabet = SeatAlphabet>
+class SeatingAutomaton
+{
+public:
+    SeatingAutomaton(const std::vector<std::string>& Lines)
+        : SeatingAutomaton(ParseSeatMap<Alphabet>(Lines))
+    {
+    }
 
-    for (int y = 1; y < DIM; y++)
+    // Run one generation, returning whether anything changed
+    bool Step()
     {
-        for (int x = 1; x < DIM; x++)
+        bool Changed = false;
+        for (int Seat = 0; Seat < (int)Seats.size(); Seat++)
         {
-            // floor, do nothing
-            if (Ferry->IsFloor(x, y)) continue;
+            int Cell = Seats[Seat];
+            uint8_t Filled = Occupied[Cell];
+            Next[Cell] = Rules::Next(Filled, Around.Count(Occupied.data(), Seat, Cell));
+            Changed |= Next[Cell] != Filled;
+        }
 
-            int Neighbours = 0;
-            if (RelaxedRuleset) Neighbours = Ferry->CountVisibleNeighbours(x, y);
-            else Neighbours = Ferry->CountNeighbours(x, y);
+        std::swap(Occupied, Next);
+        return Changed;
+    }
 
-            // Empty seat with no neighbours - fill
-            if (!Ferry->IsFilled(x, y) && Neighbours == 0)
-            {
-                Ferry->Fill(x, y);
-                HaveMadeChanges = true;
-            }
+    // Run until nothing changes, counting generations the same way as
+    // RunBitboardSimulation. Plenty of rule sets never settle, hence the
+    // limit.
+    int Run(int MaxIterations = INT_MAX)
+    {
+        int Iterations = 1;
+        while (Step() && Iterations < MaxIterations) Iterations++;
+        return Iterations;
+    }
+
+    int OccupiedSeatsCount() const
+    {
+        return std::accumulate(Occupied.begin(), Occupied.end(), 0);
+    }
+
+    // debugging
+    void PrintLayout() const
+    {
+        std::vector<uint8_t> IsSeat(Occupied.size(), 0);
+        for (int Cell : Seats) IsSeat[Cell] = 1;
 
-            // Filled with X or more neighbours - empty
-            if (Ferry->IsFilled(x, y) && Neighbours >= MaxNeighbourTolerance)
+        for (int y = 1; y <= Height; y++)
+        {
+            for (int x = 1; x <= Width; x++)
             {
-                Ferry->Empty(x, y);
-                HaveMadeChanges = true;
+                int Cell = y * Stride + x;
+                if (!IsSeat[Cell]) std::cout << Alphabet::Floor;
+                else std::cout << (Occupied[Cell] ? Alphabet::Occupied : Alphabet::Empty);
             }
+            std::cout << std::endl;
+        }
+        std::cout << std::endl;
+    }
+
+private:
+    int Height;
+    int Width;
+    int Stride;
+
+    // cell index of every seat, in reading order
+    std::vector<int> Seats;
+
+    // occupancy of every cell including padding, current and next
+    std::vector<uint8_t> Occupied;
+    std::vector<uint8_t> Next;
+
+    Neighbourhood Around;
+
+    SeatingAutomaton(const PaddedSeatMap& Map)
+        : Height(Map.Height), Width(Map.Width), Stride(Map.Stride), Seats(Map.Seats),
+          Occupied(Map.SeatAt.size(), 0), Around(Map)
+    {
+        for (int Seat = 0; Seat < (int)Seats.size(); Seat++) Occupied[Seats[Seat]] = Map.Occupied[Seat];
+        Next = Occupied;
+    }
+};
+
+// The two rule sets from the puzzle
+using Part1Automaton = SeatingAutomaton<AdjacentNeighbourhood, SeatRules<0, 4>>;
+using Part2Automaton = SeatingAutomaton<LineOfSightNeighbourhood, SeatRules<0, 5>>;
+
+// Read the seating map as lines
+std::vector<std::string> ReadSeatMap()
+{
+    std::vector<std::string> Lines;
+    ReadInput([&Lines](std::string Line) {
+        if (!Line.empty()) Lines.push_back(Line);
+    });
+    return Lines;
+}
 
-            // everything else stays the same
+// Random seating map of the given size, roughly one floor cell in five.
+std::vector<std::string> GenerateSeatMap(int Size, uint32_t Seed = 1)
+{
+    std::mt19937 Rng(Seed);
+    std::vector<std::string> Lines(Size, std::string(Size, 'L'));
+    for (auto& Line : Lines)
+    {
+        for (auto& Cell : Line)
+        {
+            if (Rng() % 5 == 0) Cell = '.';
         }
     }
+    return Lines;
+}
+
+// Random layouts often never stabilise, so only run a fixed number of
+// generations and report the rate.
+const int BENCHMARK_GENERATIONS = 100;
+
+void BenchmarkBitboard(int Size)
+{
+    BitboardLayout Ferry(GenerateSeatMap(Size));
+
+    auto Start = std::chrono::steady_clock::now();
+    int Iterations = RunBitboardSimulation(Ferry, BENCHMARK_GENERATIONS);
+    double Seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - Start).count();
 
-    Ferry->Commit();
-    if (HaveMadeChanges) return RunSimulation(Ferry, RelaxedRuleset) + 1;
-    return 1;
+    std::cout << Size << "x" << Size << ": " << Iterations << " iterations in " << Seconds << "s ("
+              << (double)Size * Size * Iterations / Seconds / 1e9 << "G cells/s), "
+              << Ferry.OccupiedSeatsCount() << " seats occupied." << std::endl;
 }
 
-int main(int argc, char** argv)
+// Compare full and active-set seat graph simulations, for both rule sets.
+// Random maps mostly oscillate forever, which isn't what the active set is
+// for, so use the puzzle input tiled Tiles times in each direction instead.
+// Even that doesn't always settle where the copies meet, so still cap the
+// number of generations.
+const int ACTIVE_BENCHMARK_GENERATIONS = 1000;
+
+void BenchmarkActiveSet(int Tiles)
 {
-    // Two temporary storages for the layout since I'm lazy and the memory
-    // is mutated after the simulation (could copy but I closed off that
-    // path early).
-    Layout FerryPart1;
-    Layout FerryPart2;
-
-    // Fill all cells except one line around the outside
-    int row = 0;
-    ReadInput([&FerryPart1, &FerryPart2, &row](std::string Line) {
-        for (int col = 0; col < Line.size(); col++)
+    std::vector<std::string> Input = ReadSeatMap();
+    std::vector<std::string> Lines;
+    for (int i = 0; i < Tiles; i++)
+    {
+        for (auto& Line : Input)
         {
-            FerryPart1.Set(col+1, row+1, Line[col]);
-            FerryPart2.Set(col+1, row+1, Line[col]);
+            std::string Row;
+            for (int j = 0; j < Tiles; j++) Row += Line;
+            Lines.push_back(Row);
         }
-        row++;
-    });
+    }
+
+    for (bool LineOfSight : {false, true})
+    {
+        int Tolerance = LineOfSight ? 5 : 4;
+        int Occupied[2];
+        for (bool Active : {false, true})
+        {
+            SeatGraph Ferry(Lines, LineOfSight);
+
+            auto Start = std::chrono::steady_clock::now();
+            int Iterations = RunSeatGraphSimulation(Ferry, Tolerance, Active, ACTIVE_BENCHMARK_GENERATIONS);
+            double Seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - Start).count();
+
+            Occupied[Active] = Ferry.OccupiedSeatsCount();
+            std::cout << (LineOfSight ? "line of sight" : "adjacent") << (Active ? ", active set: " : ", full scan: ")
+                      << Iterations << " iterations in " << Seconds << "s, "
+                      << Occupied[Active] << " seats occupied." << std::endl;
+        }
+
+        if (Occupied[0] != Occupied[1]) throw("Active set simulation disagrees with the full scan");
+    }
+}
+
+// Time the threaded seat graph against a single thread on a random map,
+// for both rule sets. ThreadCount 0 means one per core.
+void BenchmarkThreads(int Size, int ThreadCount)
+{
+    if (ThreadCount <= 0) ThreadCount = std::max(1u, std::thread::hardware_concurrency());
+    std::vector<std::string> Lines = GenerateSeatMap(Size);
+
+    for (bool LineOfSight : {false, true})
+    {
+        int Tolerance = LineOfSight ? 5 : 4;
+        int SingleThreadOccupied = -1;
+        for (int Threads : {1, ThreadCount})
+        {
+            SeatGraph Ferry(Lines, LineOfSight);
+
+            auto Start = std::chrono::steady_clock::now();
+            int Iterations = RunParallelSeatGraphSimulation(Ferry, Tolerance, Threads, BENCHMARK_GENERATIONS);
+            double Seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - Start).count();
+
+            std::cout << (LineOfSight ? "line of sight, " : "adjacent, ") << Threads << " thread(s): "
+                      << Iterations << " iterations in " << Seconds << "s, "
+                      << Ferry.OccupiedSeatsCount() << " seats occupied." << std::endl;
+
+            if (SingleThreadOccupied < 0) SingleThreadOccupied = Ferry.OccupiedSeatsCount();
+            else if (Ferry.OccupiedSeatsCount() != SingleThreadOccupied) throw("Threaded simulation disagrees with a single thread");
+        }
+    }
+}
+
+// Run one rule set over the map and report how it ends up
+const int VARIANT_MAX_ITERATIONS = 10000;
+
+template <typename Neighbourhood, int MaxToFill, int MinToEmpty>
+void RunRuleVariant(const std::vector<std::string>& Lines)
+{
+    SeatingAutomaton<Neighbourhood, SeatRules<MaxToFill, MinToEmpty>> Ferry(Lines);
+    int Iterations = Ferry.Run(VARIANT_MAX_ITERATIONS);
+
+    std::cout << Neighbourhood::Name << ", fill with <= " << MaxToFill << ", empty with >= " << MinToEmpty << ": ";
+    if (Iterations >= VARIANT_MAX_ITERATIONS) std::cout << "still changing after " << Iterations << " iterations, ";
+    else std::cout << "stabilised after " << Iterations << " iterations, ";
+    std::cout << Ferry.OccupiedSeatsCount() << " seats occupied." << std::endl;
+}
+
+int main(int argc, char** argv)
+{
+    std::string Mode = (argc > 1) ? argv[1] : "";
+
+    if (Mode == "--bench-bitboard")
+    {
+        BenchmarkBitboard(argc > 2 ? std::stoi(argv[2]) : 2000);
+        return 0;
+    }
+
+    if (Mode == "--bench-active")
+    {
+        BenchmarkActiveSet(argc > 2 ? std::stoi(argv[2]) : 5);
+        return 0;
+    }
+
+    if (Mode == "--bench-threads")
+    {
+        BenchmarkThreads(argc > 2 ? std::stoi(argv[2]) : 2000, argc > 3 ? std::stoi(argv[3]) : 0);
+        return 0;
+    }
+
+    // A handful of other rule sets over the same map
+    if (Mode == "--variants")
+    {
+        std::vector<std::string> Lines = ReadSeatMap();
+        RunRuleVariant<AdjacentNeighbourhood, 0, 3>(Lines);
+        RunRuleVariant<AdjacentNeighbourhood, 0, 4>(Lines);
+        RunRuleVariant<AdjacentNeighbourhood, 0, 5>(Lines);
+        RunRuleVariant<AdjacentNeighbourhood, 1, 4>(Lines);
+        RunRuleVariant<AdjacentNeighbourhood, 1, 5>(Lines);
+        RunRuleVariant<LineOfSightNeighbourhood, 0, 4>(Lines);
+        RunRuleVariant<LineOfSightNeighbourhood, 0, 5>(Lines);
+        RunRuleVariant<LineOfSightNeighbourhood, 0, 6>(Lines);
+        RunRuleVariant<LineOfSightNeighbourhood, 1, 5>(Lines);
+        RunRuleVariant<LineOfSightNeighbourhood, 1, 6>(Lines);
+        return 0;
+    }
+
+    // Both parts on seat graphs split across threads
+    if (Mode == "--threads")
+    {
+        int ThreadCount = (argc > 2) ? std::stoi(argv[2]) : std::max(1u, std::thread::hardware_concurrency());
+        std::vector<std::string> Lines = ReadSeatMap();
+        SeatGraph FerryPart1(Lines, false);
+        SeatGraph FerryPart2(Lines, true);
+
+        int Iterations = RunParallelSeatGraphSimulation(FerryPart1, 4, ThreadCount);
+        std::cout << "(Part1) Simulation stabilised after " << Iterations << " iterations." << std::endl;
+        std::cout << FerryPart1.OccupiedSeatsCount() << " seats were occupied." << std::endl;
+
+        Iterations = RunParallelSeatGraphSimulation(FerryPart2, 5, ThreadCount);
+        std::cout << std::endl << "(Part2) Simulation stabilised after " << Iterations << " iterations." << std::endl;
+        std::cout << FerryPart2.OccupiedSeatsCount() << " seats were occupied." << std::endl;
+        return 0;
+    }
+
+    // Both parts on the precomputed seat graphs, optionally only
+    // re-evaluating seats near the ones that last changed
+    if (Mode == "--seat-graph" || Mode == "--active")
+    {
+        bool Active = Mode == "--active";
+        std::vector<std::string> Lines = ReadSeatMap();
+        SeatGraph FerryPart1(Lines, false);
+        SeatGraph FerryPart2(Lines, true);
+
+        int Iterations = RunSeatGraphSimulation(FerryPart1, 4, Active);
+        std::cout << "(Part1) Simulation stabilised after " << Iterations << " iterations." << std::endl;
+        std::cout << FerryPart1.OccupiedSeatsCount() << " seats were occupied." << std::endl;
+
+        Iterations = RunSeatGraphSimulation(FerryPart2, 5, Active);
+        std::cout << std::endl << "(Part2) Simulation stabilised after " << Iterations << " iterations." << std::endl;
+        std::cout << FerryPart2.OccupiedSeatsCount() << " seats were occupied." << std::endl;
+        return 0;
+    }
+
+    // Part 1 on the bitboard engine
+    if (Mode == "--bitboard")
+    {
+        BitboardLayout Ferry(ReadSeatMap());
+        int Iterations = RunBitboardSimulation(Ferry);
+        std::cout << "(Part1) Simulation stabilised after " << Iterations << " iterations." << std::endl;
+        std::cout << Ferry.OccupiedSeatsCount() << " seats were occupied." << std::endl;
+        return 0;
+    }
 
-    // switch storage pointers since we used the Set interface to
-    // it above, which only writes to the new storage location.
-    FerryPart1.Commit();
-    FerryPart2.Commit();
+    // Each part gets its own copy of the map, sized from the input
+    std::vector<std::string> Lines = ReadSeatMap();
+    Part1Automaton FerryPart1(Lines);
+    Part2Automaton FerryPart2(Lines);
 
     // Part1
-    int Iterations = RunSimulation(&FerryPart1);
+    int Iterations = FerryPart1.Run();
     std::cout << "(Part1) Simulation stabilised after " << Iterations << " iterations." << std::endl;
     std::cout << FerryPart1.OccupiedSeatsCount() << " seats were occupied." << std::endl;
 
     // Part2
-    Iterations = RunSimulation(&FerryPart2, true);
+    Iterations = FerryPart2.Run();
     std::cout << std::endl << "(Part2) Simulation stabilised after " << Iterations << " iterations." << std::endl;
     std::cout << FerryPart2.OccupiedSeatsCount() << " seats were occupied." << std::endl;
 }
\ No newline at end of file
@@ -4,6 +4,9 @@
 #include <filesystem>
 #include <vector>
 #include <map>
+#include <array>
+#include <thread>
+#include <algorithm>
 
 const std::string INPUT_FILENAME = "input.txt";
 
@@ -112,8 +115,164 @@ void tallyAllAnsweredGroupTotals()
     std::cout << "Everyone in each group answered this number of questions: " << totalsWhereEveryoneAnswered << std::endl;
 }
 
+// Number of distinct questions (a-z) in the survey.
+const int QUESTION_COUNT = 26;
+
+// Everything the analysts want out of a range of groups. Each worker
+// thread fills one of these for its own slice of the input and they are
+// merged at the end, so no locking is needed.
+struct GroupStats
+{
+    int DistinctTotal = 0;
+    int AllAnsweredTotal = 0;
+
+    // Per question, how many groups had anyone / everyone answer it.
+    std::array<int, QUESTION_COUNT> AnyAnswered{};
+    std::array<int, QUESTION_COUNT> AllAnswered{};
+
+    // Group size to number of groups of that size.
+    std::map<int, int> GroupSizes;
+
+    void Merge(const GroupStats& Other)
+    {
+        DistinctTotal += Other.DistinctTotal;
+        AllAnsweredTotal += Other.AllAnsweredTotal;
+        for (int q = 0; q < QUESTION_COUNT; q++)
+        {
+            AnyAnswered[q] += Other.AnyAnswered[q];
+            AllAnswered[q] += Other.AllAnswered[q];
+        }
+        for (const auto& [Size, Count] : Other.GroupSizes) GroupSizes[Size] += Count;
+    }
+};
+
+// Read the whole input up front so it can be shared between threads.
+std::vector<std::string> readLines()
+{
+    std::ifstream ifs;
+    ifs.open(INPUT_FILENAME);
+
+    if (ifs.fail())
+    {
+        std::cout << std::filesystem::current_path() << std::endl;
+        throw("Failed to open input file");
+    }
+
+    std::vector<std::string> Lines;
+    while (!ifs.eof())
+    {
+        std::string Line;
+        std::getline(ifs, Line);
+        Lines.push_back(Line);
+    }
+    return Lines;
+}
+
+// Find the line ranges [first, last) of each group, so the groups can be
+// handed out to threads without splitting any of them.
+std::vector<std::pair<int, int>> findGroupBoundaries(const std::vector<std::string>& Lines)
+{
+    std::vector<std::pair<int, int>> Boundaries;
+    int Start = 0;
+    int LineCount = Lines.size();
+    for (int i = 0; i <= LineCount; i++)
+    {
+        if (i == LineCount || Lines[i] == "")
+        {
+            // skip runs of blank lines rather than making empty groups
+            if (i > Start) Boundaries.push_back({Start, i});
+            Start = i + 1;
+        }
+    }
+    return Boundaries;
+}
+
+// Tally a contiguous range of groups. Each person's answers become a bitmask,
+// so "anyone answered" is an OR and "everyone answered" is an AND over the group.
+void tallyGroups(const std::vector<std::string>& Lines, const std::vector<std::pair<int, int>>& Boundaries,
+                 int FirstGroup, int LastGroup, GroupStats& OutStats)
+{
+    for (int g = FirstGroup; g < LastGroup; g++)
+    {
+        const auto& [Start, End] = Boundaries[g];
+        uint32_t AnyMask = 0;
+        uint32_t AllMask = ~0u;
+
+        for (int i = Start; i < End; i++)
+        {
+            uint32_t PersonMask = 0;
+            for (char Answer : Lines[i])
+            {
+                if (Answer < 'a' || Answer > 'z') continue;
+                PersonMask |= 1u << (Answer - 'a');
+            }
+            AnyMask |= PersonMask;
+            AllMask &= PersonMask;
+        }
+
+        OutStats.GroupSizes[End - Start]++;
+        for (int q = 0; q < QUESTION_COUNT; q++)
+        {
+            if (AnyMask & (1u << q)) OutStats.AnyAnswered[q]++;
+            if (AllMask & (1u << q)) OutStats.AllAnswered[q]++;
+        }
+        OutStats.DistinctTotal += __builtin_popcount(AnyMask);
+        OutStats.AllAnsweredTotal += __builtin_popcount(AllMask);
+    }
+}
+
+// Parallel mode: split the groups evenly across threads, tally each slice
+// independently and merge the results. Produces the same totals as the two
+// functions above plus the per-question and group size histograms.
+void tallyGroupStatsParallel()
+{
+    std::vector<std::string> Lines = readLines();
+    std::vector<std::pair<int, int>> Boundaries = findGroupBoundaries(Lines);
+
+    int ThreadCount = std::max(1u, std::thread::hardware_concurrency());
+    int GroupCount = Boundaries.size();
+    int GroupsPerThread = (GroupCount + ThreadCount - 1) / ThreadCount;
+
+    std::vector<GroupStats> ThreadStats(ThreadCount);
+    std::vector<std::thread> Threads;
+    for (int t = 0; t < ThreadCount; t++)
+    {
+        int FirstGroup = std::min(t * GroupsPerThread, GroupCount);
+        int LastGroup = std::min(FirstGroup + GroupsPerThread, GroupCount);
+        Threads.emplace_back(tallyGroups, std::cref(Lines), std::cref(Boundaries), FirstGroup, LastGroup, std::ref(ThreadStats[t]));
+    }
+
+    GroupStats Stats;
+    for (int t = 0; t < ThreadCount; t++)
+    {
+        Threads[t].join();
+        Stats.Merge(ThreadStats[t]);
+    }
+
+    std::cout << "Total number of answers from all groups: " << Stats.DistinctTotal << std::endl;
+    std::cout << "Everyone in each group answered this number of questions: " << Stats.AllAnsweredTotal << std::endl;
+
+    std::cout << std::endl << "Question: groups where anyone answered / everyone answered" << std::endl;
+    for (int q = 0; q < QUESTION_COUNT; q++)
+    {
+        std::cout << (char)('a' + q) << ": " << Stats.AnyAnswered[q] << " / " << Stats.AllAnswered[q] << std::endl;
+    }
+
+    std::cout << std::endl << "Group size: number of groups" << std::endl;
+    for (const auto& [Size, Count] : Stats.GroupSizes)
+    {
+        std::cout << Size << ": " << Count << std::endl;
+    }
+}
+
 int main(int argc, char** argv)
 {
+    if (argc > 1 && std::string(argv[1]) == "--parallel")
+    {
+        tallyGroupStatsParallel();
+        return 0;
+    }
+
     readInput();
     tallyDistinctGroupTotals();
     tallyAllAnsweredGroupTotals();
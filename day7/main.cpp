@@ -3,103 +3,197 @@
 #include <string>
 #include <filesystem>
 #include <vector>
-#include <regex>
-#include <map>
-#include <set>
+#include <string_view>
+#include <charconv>
+#include <thread>
+#include <unordered_map>
+#include <algorithm>
+#include <random>
+#include <chrono>
 
 const std::string INPUT_FILENAME = "input.txt";
 const std::string TARGET_BAG = "shiny gold";
 
-struct Node
+// Bag names are interned to dense integer IDs as they are parsed, so
+// the graph itself only ever deals with indices and the names are only
+// needed again for output.
+std::unordered_map<std::string, uint32_t> BagIds;
+std::vector<std::string> BagNames;
+
+// A single "Parent bags contain Count Child bags" relationship, as parsed.
+struct Edge
 {
-    std::string Name;
-    std::vector<std::pair<int, Node*>> Children;
-    std::vector<Node*> Parents;
+    uint32_t Parent;
+    uint32_t Child;
+    uint32_t Count;
 };
 
-// store all nodes for later lookup when constructing the graph
-std::map<std::string, Node*> NodeMap;
+// All edges from the input, in the order they were read. The graph is
+// built from this once everything has been parsed.
+std::vector<Edge> Edges;
+
+// The bag graph in compressed sparse row form. The children of bag i
+// are ChildIds[ChildOffsets[i]] up to (not including) ChildIds[ChildOffsets[i+1]],
+// with the matching number of bags in ChildCounts. Parents are stored the
+// same way so we can walk the graph in either direction.
+struct BagGraph
+{
+    std::vector<uint32_t> ChildOffsets;
+    std::vector<uint32_t> ChildIds;
+    std::vector<uint32_t> ChildCounts;
+
+    std::vector<uint32_t> ParentOffsets;
+    std::vector<uint32_t> ParentIds;
 
-// map of name to children counts and names to resolve once we have everything parsed
-std::map<std::string, std::vector<std::pair<int, std::string>>> UnresolvedNodeMap;
+    uint32_t Size() const { return ChildOffsets.size() - 1; }
+} Graph;
 
-// add a single leaf node
-// has no dependencies so it is easy
-void addLeafNode(std::string Name)
+// Look up the ID for a bag name, giving it the next free ID if we
+// haven't seen it before. Bags can be referenced as children before
+// their own rule is read, so this is also how placeholders get created.
+uint32_t internBag(const std::string& Name)
 {
-    Node* CurrentNode = new Node();
-    CurrentNode->Name = Name;
-    NodeMap.insert({Name, CurrentNode});
+    auto [it, inserted] = BagIds.try_emplace(Name, BagNames.size());
+    if (inserted) BagNames.push_back(Name);
+    return it->second;
 }
 
-// Returns true if the node was successfully added to the NodeMap,
-// false otherwise.
-bool addBranchNode(std::string Name, std::vector<std::pair<int, std::string>> Children, bool AddToUnresolved = true)
+// Rules parsed from one chunk of the input. Each parsing thread interns
+// names into its own table (views into the input text, so no copies) and
+// the tables are merged into the global one afterwards.
+struct ParsedRules
 {
-    // check that all children are known, otherwise put this node on the
-    // UnresolvedNodeList "queue" to be added to the graph later.
-    for (const auto& [Count, ChildName] : Children)
+    std::unordered_map<std::string_view, uint32_t> Ids;
+    std::vector<std::string_view> Names;
+    std::vector<Edge> Edges;
+
+    uint32_t Intern(std::string_view Name)
     {
-        if (NodeMap.count(ChildName) != 1)
-        {
-            // Child wasn't found, can't put this node and its children
-            // into the node list yet.
-            // We skip this if we are resolving everything.
-            if (AddToUnresolved) UnresolvedNodeMap.insert({Name, Children});
-            return false;
-        }
+        auto [it, inserted] = Ids.try_emplace(Name, Names.size());
+        if (inserted) Names.push_back(Name);
+        return it->second;
     }
+};
+
+// Split the next space separated word off the front of Rest.
+std::string_view nextWord(std::string_view& Rest)
+{
+    size_t End = Rest.find(' ');
+    std::string_view Word = Rest.substr(0, End);
+    Rest = (End == std::string_view::npos) ? std::string_view() : Rest.substr(End + 1);
+    return Word;
+}
+
+// Split a two word bag name off the front of Rest, as a single view.
+std::string_view nextBagName(std::string_view& Rest)
+{
+    const char* Start = Rest.data();
+    nextWord(Rest);
+    std::string_view Second = nextWord(Rest);
+    return std::string_view(Start, Second.data() + Second.size() - Start);
+}
+
+// Parse a single "adj color bags contain N adj color bags, ..." rule in
+// place, without any regexes or copies. Returns false if the line doesn't
+// look like a rule.
+bool parseRule(std::string_view Line, ParsedRules& Rules)
+{
+    std::string_view Rest = Line;
+    std::string_view Name = nextBagName(Rest);
+    if (nextWord(Rest) != "bags" || nextWord(Rest) != "contain") return false;
 
-    // All children are present - add the node!
-    // This also means adding this node to the parent list of
-    // each child to facilitate navigation of the graph.
-    Node* CurrentNode = new Node();
-    CurrentNode->Name = Name;
-    for (const auto& [Count, ChildName] : Children)
+    uint32_t Parent = Rules.Intern(Name);
+
+    // leaf nodes have no dependencies
+    if (Rest == "no other bags.") return true;
+
+    while (!Rest.empty())
     {
-        Node* ChildNode = NodeMap[ChildName];
+        std::string_view CountWord = nextWord(Rest);
+        uint32_t Count = 0;
+        auto [End, Error] = std::from_chars(CountWord.data(), CountWord.data() + CountWord.size(), Count);
+        if (Error != std::errc() || End != CountWord.data() + CountWord.size()) return false;
+
+        std::string_view ChildName = nextBagName(Rest);
+
+        // "bag," or "bags," between children, "bag." or "bags." at the end
+        std::string_view BagWord = nextWord(Rest);
+        if (BagWord.empty() || (BagWord.back() != ',' && BagWord.back() != '.')) return false;
 
-        // add up and down relationship pointers
-        ChildNode->Parents.push_back(CurrentNode);
-        CurrentNode->Children.push_back({Count, ChildNode});
+        Rules.Edges.push_back({Parent, Rules.Intern(ChildName), Count});
+        if (BagWord.back() == '.') break;
     }
 
-    // finally add this node to the list of resolved nodes
-    NodeMap.insert({Name, CurrentNode});
     return true;
 }
 
-void parseLine(std::string Line)
+// Parse every rule in a chunk of text that starts and ends on a line boundary.
+void parseChunk(std::string_view Text, ParsedRules& Rules)
 {
-    // Parse leaf nodes that have no dependencies.
-    std::regex LeafNodeRE("^(\\w+ \\w+) bags contain no other bags\\.$");
-    std::cmatch cmatch;
-    if (std::regex_match(Line.c_str(), cmatch, LeafNodeRE))
+    // rough guess of one new bag name per line, to avoid rehashing
+    Rules.Ids.reserve(Text.size() / 64);
+
+    while (!Text.empty())
     {
-        addLeafNode(cmatch[1].str());
-        return;
+        size_t End = Text.find('\n');
+        std::string_view Line = Text.substr(0, End);
+        Text = (End == std::string_view::npos) ? std::string_view() : Text.substr(End + 1);
+
+        if (!Line.empty() && Line.back() == '\r') Line.remove_suffix(1);
+        if (Line.empty()) continue;
+        parseRule(Line, Rules);
     }
+}
+
+// Don't bother splitting work up into chunks smaller than this.
+const size_t MIN_CHUNK_BYTES = 1 << 20;
 
-    // Parse "branch" nodes in two parts: the prefix (containing bag)
-    // and then the bags contained within. I can't figure out how to retrieve values with ()+
-    // so this is the only way for now.
-    std::regex ContainingRE("^(\\w+ \\w+) bags contain (.*)$");
-    std::regex_match(Line.c_str(), cmatch, ContainingRE);
-    
-    std::string Name = cmatch[1].str();
-    std::string Suffix = cmatch[2].str();
+// Parse a whole rule file, split on line boundaries across threads. Each
+// thread builds its own name table and edge list, which are then merged
+// into BagIds/BagNames/Edges in chunk order.
+void parseRules(std::string_view Text, unsigned ThreadCount = std::thread::hardware_concurrency())
+{
+    size_t ChunkCount = std::clamp<size_t>(Text.size() / MIN_CHUNK_BYTES, 1, std::max(1u, ThreadCount));
+
+    // Find the chunk boundaries, moving each one forward to the next line
+    std::vector<std::string_view> Chunks;
+    size_t Start = 0;
+    for (size_t c = 1; c <= ChunkCount && Start < Text.size(); c++)
+    {
+        size_t End = Text.size();
+        if (c < ChunkCount)
+        {
+            End = Text.find('\n', std::max(Start, Text.size() * c / ChunkCount));
+            End = (End == std::string_view::npos) ? Text.size() : End + 1;
+        }
+        Chunks.push_back(Text.substr(Start, End - Start));
+        Start = End;
+    }
 
-    std::regex BagsRE("((\\d+) (\\w+ \\w+) bags?[,. ]+)");
-    std::smatch smatch;
-    std::vector<std::pair<int, std::string>> Children;
-    while (std::regex_search(Suffix, smatch, BagsRE))
+    std::vector<ParsedRules> Parsed(Chunks.size());
+    std::vector<std::thread> Threads;
+    for (size_t c = 0; c < Chunks.size(); c++)
     {
-        // 2 & 3 are the submatches of the bag count and two word name of the child bag
-        Children.push_back({std::stoi(smatch[2].str()), smatch[3].str()});
-        Suffix = smatch.suffix();
+        Threads.emplace_back(parseChunk, Chunks[c], std::ref(Parsed[c]));
     }
+    for (auto& t : Threads) t.join();
+
+    size_t NameCount = 0;
+    for (const auto& Rules : Parsed) NameCount += Rules.Names.size();
+    BagIds.reserve(BagIds.size() + NameCount);
+
+    for (const auto& Rules : Parsed)
+    {
+        // map this thread's IDs onto the global ones
+        std::vector<uint32_t> GlobalIds;
+        GlobalIds.reserve(Rules.Names.size());
+        for (const auto& Name : Rules.Names) GlobalIds.push_back(internBag(std::string(Name)));
 
-    addBranchNode(Name, Children);
+        for (const auto& e : Rules.Edges)
+        {
+            Edges.push_back({GlobalIds[e.Parent], GlobalIds[e.Child], e.Count});
+        }
+    }
 }
 
 void readInput()
@@ -113,85 +207,664 @@ void readInput()
         throw("Failed to open input file");
     }
 
-    while (!ifs.eof())
+    std::string Text((std::istreambuf_iterator<char>(ifs)), std::istreambuf_iterator<char>());
+    parseRules(Text);
+}
+
+// Turn the parsed edge list into the CSR arrays. Since every bag already
+// has an ID, the order the rules appeared in doesn't matter. This is a
+// counting sort: one pass to count edges per bag, a prefix sum to get the
+// offsets, then one pass to drop each edge into its slot, so O(V+E) overall.
+void buildGraph()
+{
+    uint32_t BagCount = BagNames.size();
+
+    Graph.ChildOffsets.assign(BagCount + 1, 0);
+    Graph.ParentOffsets.assign(BagCount + 1, 0);
+    for (const auto& e : Edges)
     {
-        std::string Line;
-        std::getline(ifs, Line);
+        Graph.ChildOffsets[e.Parent + 1]++;
+        Graph.ParentOffsets[e.Child + 1]++;
+    }
+    for (uint32_t i = 0; i < BagCount; i++)
+    {
+        Graph.ChildOffsets[i + 1] += Graph.ChildOffsets[i];
+        Graph.ParentOffsets[i + 1] += Graph.ParentOffsets[i];
+    }
+
+    // Next free slot for each bag, starting from its offset
+    std::vector<uint32_t> ChildFill(Graph.ChildOffsets.begin(), Graph.ChildOffsets.end() - 1);
+    std::vector<uint32_t> ParentFill(Graph.ParentOffsets.begin(), Graph.ParentOffsets.end() - 1);
+
+    Graph.ChildIds.resize(Edges.size());
+    Graph.ChildCounts.resize(Edges.size());
+    Graph.ParentIds.resize(Edges.size());
+    for (const auto& e : Edges)
+    {
+        uint32_t ChildSlot = ChildFill[e.Parent]++;
+        Graph.ChildIds[ChildSlot] = e.Child;
+        Graph.ChildCounts[ChildSlot] = e.Count;
+
+        Graph.ParentIds[ParentFill[e.Child]++] = e.Parent;
+    }
+}
+
+// Generate a rule file worth of lines for RuleCount bags in random order.
+// Bags are split into GENERATED_DEPTH layers and only contain bags from
+// the next layer down, so the result is always a DAG and the contained
+// totals stay well inside 64 bits.
+const uint32_t GENERATED_DEPTH = 8;
+
+std::string generateRules(uint32_t RuleCount, uint32_t Seed = 1)
+{
+    std::mt19937 Rng(Seed);
+    std::vector<std::string> Lines;
+    Lines.reserve(RuleCount);
+    uint32_t LayerSize = std::max<uint32_t>(1, RuleCount / GENERATED_DEPTH);
+
+    for (uint32_t i = 0; i < RuleCount; i++)
+    {
+        std::string Line = "gen" + std::to_string(i) + " bag bags contain ";
+        uint32_t NextLayer = (i / LayerSize + 1) * LayerSize;
+        int ChildCount = (NextLayer < RuleCount) ? Rng() % 5 : 0;
+        if (ChildCount == 0) Line += "no other bags.";
+
+        for (int c = 0; c < ChildCount; c++)
+        {
+            uint32_t Child = NextLayer + Rng() % std::min(LayerSize, RuleCount - NextLayer);
+            int Count = 1 + Rng() % 5;
+            if (c > 0) Line += ", ";
+            Line += std::to_string(Count) + " gen" + std::to_string(Child) + " bag " + (Count == 1 ? "bag" : "bags");
+        }
+        if (ChildCount > 0) Line += ".";
+        Lines.push_back(Line);
+    }
+
+    std::shuffle(Lines.begin(), Lines.end(), Rng);
+
+    std::string Text;
+    for (const auto& Line : Lines) Text += Line + "\n";
+    return Text;
+}
 
-        parseLine(Line);
+// Time parsing (on one thread, then on all of them) and graph construction
+// separately for a generated rule file.
+void benchmarkLoad(uint32_t RuleCount)
+{
+    std::string Text = generateRules(RuleCount);
+
+    auto Start = std::chrono::steady_clock::now();
+    parseRules(Text, 1);
+    auto SingleParsed = std::chrono::steady_clock::now();
+
+    BagIds.clear();
+    BagNames.clear();
+    Edges.clear();
+
+    auto ParallelStart = std::chrono::steady_clock::now();
+    parseRules(Text);
+    auto Parsed = std::chrono::steady_clock::now();
+    buildGraph();
+    auto Built = std::chrono::steady_clock::now();
+
+    auto ms = [](auto d) { return std::chrono::duration<double, std::milli>(d).count(); };
+    std::cout << RuleCount << " rules (" << Text.size() / 1024 << "KB), " << BagNames.size() << " bags, " << Edges.size() << " edges" << std::endl;
+    std::cout << "Parse: " << ms(SingleParsed - Start) << "ms on 1 thread, " << ms(Parsed - ParallelStart) << "ms on "
+              << std::max(1u, std::thread::hardware_concurrency()) << ", build: " << ms(Built - Parsed) << "ms" << std::endl;
+}
+
+// Order the bags so that every bag comes before all of the bags it contains
+// (Kahn's algorithm over the child edges). Walking this backwards gives us
+// children before parents. A bag that can (eventually) contain itself would
+// make the contained count infinite, so that is treated as bad input.
+std::vector<uint32_t> topologicalOrder()
+{
+    uint32_t BagCount = Graph.Size();
+    std::vector<uint32_t> Order;
+    Order.reserve(BagCount);
+
+    // number of parents of each bag that haven't been placed yet
+    std::vector<uint32_t> PendingParents(BagCount);
+    for (uint32_t Bag = 0; Bag < BagCount; Bag++)
+    {
+        PendingParents[Bag] = Graph.ParentOffsets[Bag + 1] - Graph.ParentOffsets[Bag];
+        if (PendingParents[Bag] == 0) Order.push_back(Bag);
+    }
+
+    // Order doubles as the queue of bags ready to be placed
+    for (uint32_t Next = 0; Next < Order.size(); Next++)
+    {
+        uint32_t Bag = Order[Next];
+        for (uint32_t i = Graph.ChildOffsets[Bag]; i < Graph.ChildOffsets[Bag + 1]; i++)
+        {
+            if (--PendingParents[Graph.ChildIds[i]] == 0) Order.push_back(Graph.ChildIds[i]);
+        }
+    }
+
+    if (Order.size() != BagCount) throw("Bag rules contain a cycle");
+    return Order;
+}
+
+// Calculate how many bags every bag contains in a single pass. Children
+// are always finished before their parents, so each subtree is only ever
+// summed once no matter how many bags share it. Totals can get very big
+// on deep generated graphs, so overflow is checked rather than wrapping.
+std::vector<uint64_t> calculateContainedTotals()
+{
+    std::vector<uint32_t> Order = topologicalOrder();
+    std::vector<uint64_t> Totals(Graph.Size(), 0);
+
+    for (auto it = Order.rbegin(); it != Order.rend(); it++)
+    {
+        uint32_t Bag = *it;
+        uint64_t Total = 0;
+
+        for (uint32_t i = Graph.ChildOffsets[Bag]; i < Graph.ChildOffsets[Bag + 1]; i++)
+        {
+            // each child bag counts itself plus everything inside it
+            uint64_t ChildTotal = 0;
+            if (__builtin_add_overflow(Totals[Graph.ChildIds[i]], 1, &ChildTotal) ||
+                __builtin_mul_overflow(ChildTotal, (uint64_t)Graph.ChildCounts[i], &ChildTotal) ||
+                __builtin_add_overflow(Total, ChildTotal, &Total))
+            {
+                throw("Contained bag count overflowed 64 bits");
+            }
+        }
+
+        Totals[Bag] = Total;
+    }
+
+    return Totals;
+}
+
+// Starting from a given bag, walk up through the parents to find all
+// of the distinct bags that could contain it. Bags are only ever queued
+// once, so shared ancestors aren't walked again.
+uint32_t countContainingBags(uint32_t StartingBag)
+{
+    std::vector<bool> Visited(Graph.Size(), false);
+    std::vector<uint32_t> Stack = {StartingBag};
+    Visited[StartingBag] = true;
+    uint32_t Count = 0;
+
+    while (!Stack.empty())
+    {
+        uint32_t Bag = Stack.back();
+        Stack.pop_back();
+
+        for (uint32_t i = Graph.ParentOffsets[Bag]; i < Graph.ParentOffsets[Bag + 1]; i++)
+        {
+            uint32_t Parent = Graph.ParentIds[i];
+            if (Visited[Parent]) continue;
+
+            Visited[Parent] = true;
+            Stack.push_back(Parent);
+            Count++;
+        }
     }
+
+    return Count;
 }
 
-// Iteratively resolve "branch" nodes until the UnresolvedNodeMap is empty.
-// This is probably a very expensive way to do it.
-void resolveBranchNodes()
+// Memory we're prepared to spend on reachability bitsets at any one time.
+const size_t CLOSURE_BUDGET_BYTES = 64 << 20;
+
+// Count the distinct containing bags for every bag at once. This is a
+// transitive closure done a block of source bags at a time: each bag gets
+// a bitset of which sources in the block can reach it, the bitsets are
+// OR'd down the child edges in topological order, and the popcounts are
+// accumulated per bag. The block is as wide as the memory budget allows,
+// so the whole thing is O(V * (V + E) / 64) word operations.
+std::vector<uint32_t> calculateAncestorCounts()
 {
-    while (UnresolvedNodeMap.size() > 0)
+    std::vector<uint32_t> Order = topologicalOrder();
+    uint32_t BagCount = Graph.Size();
+    std::vector<uint32_t> Counts(BagCount, 0);
+    if (BagCount == 0) return Counts;
+
+    // Rows are indexed by position in the topological order rather than
+    // bag ID, so propagation walks memory front to back.
+    std::vector<uint32_t> Position(BagCount);
+    for (uint32_t pos = 0; pos < BagCount; pos++) Position[Order[pos]] = pos;
+
+    size_t Words = std::clamp<size_t>(CLOSURE_BUDGET_BYTES / (8 * (size_t)BagCount), 1, 64);
+    uint32_t BlockBags = Words * 64;
+    std::vector<uint64_t> Bits(Words * BagCount);
+
+    // Sources only reach bags later in the order, so each block can start
+    // propagating from its own first source.
+    for (uint32_t Start = 0; Start < BagCount; Start += BlockBags)
     {
-        for (const auto& [Name, Children] : UnresolvedNodeMap)
+        uint32_t End = std::min(Start + BlockBags, BagCount);
+        std::fill(Bits.begin() + Start * Words, Bits.end(), 0);
+        for (uint32_t pos = Start; pos < End; pos++)
         {
-            bool success = addBranchNode(Name, Children, false);
+            uint32_t k = pos - Start;
+            Bits[pos * Words + k / 64] |= 1ull << (k % 64);
+        }
+
+        for (uint32_t pos = Start; pos < BagCount; pos++)
+        {
+            const uint64_t* Row = &Bits[pos * Words];
+            uint32_t Bag = Order[pos];
+
+            uint32_t Reachable = 0;
+            for (size_t w = 0; w < Words; w++) Reachable += __builtin_popcountll(Row[w]);
 
-            // was inserted to the NodeMap successfully
-            if (success)
+            // a bag doesn't contain itself
+            if (pos < End) Reachable--;
+            Counts[Bag] += Reachable;
+
+            for (uint32_t i = Graph.ChildOffsets[Bag]; i < Graph.ChildOffsets[Bag + 1]; i++)
             {
-                // Does this invalidate this for loop iterator???
-                // Answer: YES.
-                // Should do this better with an explicit iterator but I'm lazy.
-                UnresolvedNodeMap.erase(Name);
-                break;
+                uint64_t* ChildRow = &Bits[Position[Graph.ChildIds[i]] * Words];
+                for (size_t w = 0; w < Words; w++) ChildRow[w] |= Row[w];
             }
         }
     }
+
+    return Counts;
 }
 
-// set of node names that we've visited in graph traversal, to
-// avoid doubling up on all the kinds of bags that could contain
-// the target bag.
-std::set<std::string> VisitedNodeNames;
+// Precomputed answers to both questions for every bag, so any number of
+// queries can be answered with a lookup.
+struct BagQueryEngine
+{
+    std::vector<uint64_t> ContainedTotals;
+    std::vector<uint32_t> AncestorCounts;
+
+    BagQueryEngine() : ContainedTotals(calculateContainedTotals()), AncestorCounts(calculateAncestorCounts()) {}
 
-// Starting from a given bag name, do a search to find all ancestor
-// nodes and return the count. Hooray recursion.
-void findContainingBagCount(Node* StartingNode)
+    uint64_t ContainedTotal(uint32_t Bag) const { return ContainedTotals[Bag]; }
+    uint32_t AncestorCount(uint32_t Bag) const { return AncestorCounts[Bag]; }
+};
+
+// Answer both questions for each of the named bags.
+void answerQueries(const std::vector<std::string>& Names)
 {
-    for (auto Parent : StartingNode->Parents)
+    BagQueryEngine Engine;
+
+    for (const auto& Name : Names)
     {
-        // add parent to set
-        VisitedNodeNames.emplace(Parent->Name);
+        if (BagIds.count(Name) != 1)
+        {
+            std::cout << Name << " bag not found." << std::endl;
+            continue;
+        }
 
-        // visit all the parents recursively
-        findContainingBagCount(Parent);
+        uint32_t Bag = BagIds.at(Name);
+        std::cout << Name << " bag has " << Engine.AncestorCount(Bag) << " containing bags and contains "
+                  << Engine.ContainedTotal(Bag) << " other bags." << std::endl;
     }
 }
 
-// Starting from a given bag name, do a search to find all child
-// nodes and return the total count, multiplied by how many bags
-// of each child type this current bag can hold.
-int calculateChildBagCount(Node* StartingNode)
+// Time answering both questions for every bag of a generated graph, and
+// spot check the ancestor counts against the single bag search.
+void benchmarkQueries(uint32_t RuleCount)
 {
-    // include this bag as it will be needed by the caller's calculation
-    int bagCount = 1;
+    parseRules(generateRules(RuleCount));
+    buildGraph();
+
+    auto Start = std::chrono::steady_clock::now();
+    BagQueryEngine Engine;
+    auto Built = std::chrono::steady_clock::now();
 
-    for (const auto& [ChildCount, ChildNode] : StartingNode->Children)
+    // sum everything so the queries can't be optimised away
+    uint64_t Checksum = 0;
+    for (uint32_t Bag = 0; Bag < Graph.Size(); Bag++) Checksum += Engine.AncestorCount(Bag) + Engine.ContainedTotal(Bag);
+    auto Queried = std::chrono::steady_clock::now();
+
+    uint32_t Samples = std::min<uint32_t>(Graph.Size(), 100);
+    for (uint32_t s = 0; s < Samples; s++)
     {
-        bagCount += calculateChildBagCount(ChildNode) * ChildCount;
+        uint32_t Bag = (uint64_t)s * Graph.Size() / Samples;
+        if (countContainingBags(Bag) != Engine.AncestorCount(Bag)) throw("Ancestor count mismatch");
     }
+    auto Checked = std::chrono::steady_clock::now();
 
-    return bagCount;
+    auto ms = [](auto d) { return std::chrono::duration<double, std::milli>(d).count(); };
+    std::cout << Graph.Size() << " bags, " << Graph.ChildIds.size() << " edges, checksum " << Checksum << std::endl;
+    std::cout << "Precompute: " << ms(Built - Start) << "ms, all queries: " << ms(Queried - Built) << "ms" << std::endl;
+    std::cout << "Single bag search: " << ms(Checked - Queried) / Samples << "ms per bag" << std::endl;
+}
+
+// A mutable copy of the bag graph that keeps cached answers up to date as
+// rules are added, changed or removed, instead of rebuilding everything.
+// Changing a bag's rule can only change the contained total of that bag and
+// its ancestors, and the containing bags of its descendants, so only those
+// caches are marked dirty. Dirty answers are recomputed when next asked for.
+class IncrementalBagGraph
+{
+public:
+    // Start from the CSR graph built from the input. SetRule stops cycles
+    // being added later, but the input itself has to be checked up front
+    // (topologicalOrder throws if there is one), otherwise the first query
+    // would walk round the cycle forever.
+    IncrementalBagGraph()
+    {
+        topologicalOrder();
+        Grow();
+        for (uint32_t Bag = 0; Bag < Graph.Size(); Bag++)
+        {
+            for (uint32_t i = Graph.ChildOffsets[Bag]; i < Graph.ChildOffsets[Bag + 1]; i++)
+            {
+                Children[Bag].push_back({Graph.ChildCounts[i], Graph.ChildIds[i]});
+                Parents[Graph.ChildIds[i]].push_back(Bag);
+            }
+        }
+    }
+
+    // Add a rule for a bag, or replace its existing one. Throws and leaves
+    // the graph untouched if the new rule would let a bag contain itself.
+    void SetRule(uint32_t Bag, const std::vector<std::pair<uint32_t, uint32_t>>& NewChildren)
+    {
+        Grow();
+
+        // Any cycle through the new edges has to come back to Bag from one
+        // of its new children, without using Bag's old (outgoing) edges.
+        for (const auto& [Count, Child] : NewChildren)
+        {
+            if (Child == Bag || IsReachable(Child, Bag)) throw("Rule would make a bag contain itself");
+        }
+
+        // The containing bags of everything below Bag, before and after, may change
+        InvalidateDescendantAncestors(Bag);
+
+        for (const auto& [Count, Child] : Children[Bag])
+        {
+            auto& ChildParents = Parents[Child];
+            ChildParents.erase(std::find(ChildParents.begin(), ChildParents.end(), Bag));
+        }
+        Children[Bag] = NewChildren;
+        for (const auto& [Count, Child] : NewChildren) Parents[Child].push_back(Bag);
+
+        InvalidateDescendantAncestors(Bag);
+        InvalidateContainedTotals(Bag);
+    }
+
+    // Removing a rule just means the bag no longer contains anything. It
+    // stays in the graph since other rules may still refer to it.
+    void RemoveRule(uint32_t Bag) { SetRule(Bag, {}); }
+
+    uint64_t ContainedTotal(uint32_t Bag)
+    {
+        Grow();
+        if (!TotalValid[Bag]) RecomputeContainedTotals(Bag);
+        return ContainedTotals[Bag];
+    }
+
+    uint32_t AncestorCount(uint32_t Bag)
+    {
+        Grow();
+        if (!AncestorValid[Bag])
+        {
+            AncestorCounts[Bag] = CountAncestors(Bag);
+            AncestorValid[Bag] = true;
+        }
+        return AncestorCounts[Bag];
+    }
+
+private:
+    // Children as (count, bag) pairs, and parents, per bag.
+    std::vector<std::vector<std::pair<uint32_t, uint32_t>>> Children;
+    std::vector<std::vector<uint32_t>> Parents;
+
+    // A valid contained total implies all of its descendants are valid too,
+    // which is what lets invalidation stop early.
+    std::vector<uint64_t> ContainedTotals;
+    std::vector<bool> TotalValid;
+
+    std::vector<uint32_t> AncestorCounts;
+    std::vector<bool> AncestorValid;
+
+    // Make room for any bags interned since we last looked.
+    void Grow()
+    {
+        size_t BagCount = BagNames.size();
+        Children.resize(BagCount);
+        Parents.resize(BagCount);
+        ContainedTotals.resize(BagCount, 0);
+        TotalValid.resize(BagCount, false);
+        AncestorCounts.resize(BagCount, 0);
+        AncestorValid.resize(BagCount, false);
+    }
+
+    bool IsReachable(uint32_t From, uint32_t To) const
+    {
+        std::vector<bool> Visited(Children.size(), false);
+        std::vector<uint32_t> Stack = {From};
+        Visited[From] = true;
+
+        while (!Stack.empty())
+        {
+            uint32_t Bag = Stack.back();
+            Stack.pop_back();
+            if (Bag == To) return true;
+
+            for (const auto& [Count, Child] : Children[Bag])
+            {
+                if (Visited[Child]) continue;
+                Visited[Child] = true;
+                Stack.push_back(Child);
+            }
+        }
+        return false;
+    }
+
+    // Mark Bag and everything that can contain it as dirty. If a bag is
+    // already dirty then so are all of its ancestors, so we can stop there.
+    void InvalidateContainedTotals(uint32_t Bag)
+    {
+        std::vector<uint32_t> Stack = {Bag};
+        while (!Stack.empty())
+        {
+            uint32_t Current = Stack.back();
+            Stack.pop_back();
+            if (!TotalValid[Current]) continue;
+
+            TotalValid[Current] = false;
+            for (uint32_t Parent : Parents[Current]) Stack.push_back(Parent);
+        }
+    }
+
+    // Mark everything below Bag as needing its containing bags recounted.
+    void InvalidateDescendantAncestors(uint32_t Bag)
+    {
+        std::vector<bool> Visited(Children.size(), false);
+        std::vector<uint32_t> Stack = {Bag};
+        Visited[Bag] = true;
+
+        while (!Stack.empty())
+        {
+            uint32_t Current = Stack.back();
+            Stack.pop_back();
+
+            for (const auto& [Count, Child] : Children[Current])
+            {
+                if (Visited[Child]) continue;
+                Visited[Child] = true;
+                AncestorValid[Child] = false;
+                Stack.push_back(Child);
+            }
+        }
+    }
+
+    // Recompute the dirty totals under Bag with an iterative post-order
+    // walk, so each bag is only summed once its children are done.
+    void RecomputeContainedTotals(uint32_t Bag)
+    {
+        // pairs of bag and whether its children have been pushed yet
+        std::vector<std::pair<uint32_t, bool>> Stack = {{Bag, false}};
+
+        while (!Stack.empty())
+        {
+            auto [Current, Expanded] = Stack.back();
+            Stack.pop_back();
+            if (TotalValid[Current]) continue;
+
+            if (!Expanded)
+            {
+                Stack.push_back({Current, true});
+                for (const auto& [Count, Child] : Children[Current])
+                {
+                    if (!TotalValid[Child]) Stack.push_back({Child, false});
+                }
+                continue;
+            }
+
+            uint64_t Total = 0;
+            for (const auto& [Count, Child] : Children[Current])
+            {
+                uint64_t ChildTotal = 0;
+                if (__builtin_add_overflow(ContainedTotals[Child], 1, &ChildTotal) ||
+                    __builtin_mul_overflow(ChildTotal, (uint64_t)Count, &ChildTotal) ||
+                    __builtin_add_overflow(Total, ChildTotal, &Total))
+                {
+                    throw("Contained bag count overflowed 64 bits");
+                }
+            }
+            ContainedTotals[Current] = Total;
+            TotalValid[Current] = true;
+        }
+    }
+
+    uint32_t CountAncestors(uint32_t Bag) const
+    {
+        std::vector<bool> Visited(Parents.size(), false);
+        std::vector<uint32_t> Stack = {Bag};
+        Visited[Bag] = true;
+        uint32_t Count = 0;
+
+        while (!Stack.empty())
+        {
+            uint32_t Current = Stack.back();
+            Stack.pop_back();
+
+            for (uint32_t Parent : Parents[Current])
+            {
+                if (Visited[Parent]) continue;
+                Visited[Parent] = true;
+                Stack.push_back(Parent);
+                Count++;
+            }
+        }
+        return Count;
+    }
+};
+
+// Apply a file of rule updates to the graph, one per line:
+//   + <rule>     add a rule, or replace the existing rule for that bag
+//   - adj color  remove the rule for a bag
+//   ? adj color  print both answers for a bag
+void applyUpdates(const std::string& Filename)
+{
+    std::ifstream ifs;
+    ifs.open(Filename);
+
+    if (ifs.fail())
+    {
+        std::cout << std::filesystem::current_path() << std::endl;
+        throw("Failed to open updates file");
+    }
+
+    IncrementalBagGraph Incremental;
+
+    while (!ifs.eof())
+    {
+        std::string Line;
+        std::getline(ifs, Line);
+        if (Line.size() < 3) continue;
+
+        char Operation = Line[0];
+        std::string Argument = Line.substr(2);
+
+        if (Operation == '+')
+        {
+            ParsedRules Rule;
+            if (!parseRule(Argument, Rule))
+            {
+                std::cout << "Couldn't parse rule: " << Argument << std::endl;
+                continue;
+            }
+
+            // the rule's own bag is always the first one interned
+            std::vector<std::pair<uint32_t, uint32_t>> NewChildren;
+            for (const auto& e : Rule.Edges) NewChildren.push_back({e.Count, internBag(std::string(Rule.Names[e.Child]))});
+
+            try
+            {
+                Incremental.SetRule(internBag(std::string(Rule.Names[0])), NewChildren);
+            }
+            catch (const char* Error)
+            {
+                std::cout << Error << ": " << Argument << std::endl;
+            }
+            continue;
+        }
+
+        if (BagIds.count(Argument) != 1)
+        {
+            std::cout << Argument << " bag not found." << std::endl;
+            continue;
+        }
+        uint32_t Bag = BagIds.at(Argument);
+
+        if (Operation == '-') Incremental.RemoveRule(Bag);
+        if (Operation == '?')
+        {
+            try
+            {
+                uint32_t Ancestors = Incremental.AncestorCount(Bag);
+                uint64_t Total = Incremental.ContainedTotal(Bag);
+                std::cout << Argument << " bag has " << Ancestors << " containing bags and contains "
+                          << Total << " other bags." << std::endl;
+            }
+            catch (const char* Error)
+            {
+                std::cout << Error << ": " << Argument << std::endl;
+            }
+        }
+    }
 }
 
 int main(int argc, char** argv)
 {
+    if (argc > 1 && std::string(argv[1]) == "--bench-load")
+    {
+        benchmarkLoad(argc > 2 ? std::stoul(argv[2]) : 100000);
+        return 0;
+    }
+
+    if (argc > 1 && std::string(argv[1]) == "--bench-queries")
+    {
+        benchmarkQueries(argc > 2 ? std::stoul(argv[2]) : 20000);
+        return 0;
+    }
+
     readInput();
-    resolveBranchNodes();
+    buildGraph();
+
+    if (argc > 2 && std::string(argv[1]) == "--apply")
+    {
+        applyUpdates(argv[2]);
+        return 0;
+    }
+
+    // Any other arguments are bag names to look up
+    if (argc > 1)
+    {
+        answerQueries(std::vector<std::string>(argv + 1, argv + argc));
+        return 0;
+    }
+
+    if (BagIds.count(TARGET_BAG) != 1) throw("Target bag not found in input");
+    uint32_t Target = BagIds.at(TARGET_BAG);
 
     // Find and count all unique ancestors ("containing bags") of this bag.
-    findContainingBagCount(NodeMap[TARGET_BAG]);
-    std::cout << TARGET_BAG << " bag has " << VisitedNodeNames.size() << " containing bags." << std::endl;
+    std::cout << TARGET_BAG << " bag has " << countContainingBags(Target) << " containing bags." << std::endl;
 
     // Find and count all of the child bags of this bag.
     // This one is different as we need to multiply all of the bag counts up the chain.
-    int count = calculateChildBagCount(NodeMap[TARGET_BAG]);
-    count--; // don't count the starting bag itself!
-    std::cout << TARGET_BAG << " bag contains " << count << " other bags." << std::endl;
-}
\ No newline at end of file
+    std::vector<uint64_t> Totals = calculateContainedTotals();
+    std::cout << TARGET_BAG << " bag contains " << Totals[Target] << " other bags." << std::endl;
+}
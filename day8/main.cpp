@@ -4,7 +4,12 @@
 #include <filesystem>
 #include <vector>
 #include <regex>
-#include <set>
+#include <random>
+#include <chrono>
+#include <thread>
+#include <atomic>
+#include <numeric>
+#include <algorithm>
 
 const std::string INPUT_FILENAME = "input.txt";
 
@@ -74,17 +79,121 @@ void readInput()
     }
 }
 
-bool executeProgram(int &OutAccumulator)
+// Records which instructions have been executed in the current run. Each
+// run gets a new epoch number and an instruction counts as seen only if
+// it was stamped with the current epoch, so nothing ever needs clearing
+// between runs (fixCorruption runs the program hundreds of times).
+struct SeenStamps
+{
+    std::vector<uint32_t> Stamps;
+    uint32_t Epoch = 0;
+
+    // Start a new run over a program of the given size.
+    void NextRun(size_t ProgramSize)
+    {
+        Epoch++;
+
+        // Only clear out when the program changes size, or the epoch
+        // wraps around and old stamps could look current again.
+        if (Stamps.size() != ProgramSize || Epoch == 0)
+        {
+            Stamps.assign(ProgramSize, 0);
+            Epoch = 1;
+        }
+    }
+
+    // Mark an instruction as seen, returning whether it already was.
+    bool TestAndSet(size_t PC)
+    {
+        if (Stamps[PC] == Epoch) return true;
+        Stamps[PC] = Epoch;
+        return false;
+    }
+} SeenOpCodes;
+
+// Instrumentation for executeProgram is chosen at compile time. The
+// default policy's hooks are empty, so they compile away to nothing and
+// normal runs pay no cost for profiling being available.
+struct NoProfiler
+{
+    void OnStart() {}
+    void OnExecute(int /* PC */) {}
+    void OnRepeat(int /* PC */) {}
+};
+
+// Collects execution statistics across any number of runs, e.g. all of
+// the runs made by fixCorruption.
+struct ExecutionProfiler
+{
+    // How many times each instruction has run, over all runs
+    std::vector<uint64_t> Counts;
+    uint64_t Steps = 0;
+    uint64_t Runs = 0;
+
+    // Where the last run started to repeat itself (-1 if it didn't),
+    // and how many instructions long the loop was.
+    int FirstRepeatPC = -1;
+    uint64_t CycleLength = 0;
+
+    // Optional trace of every executed PC. Stored as zigzag varint deltas
+    // from the previous PC, so straight-line code costs one byte per step.
+    bool RecordTrace = false;
+    std::vector<uint8_t> Trace;
+
+    void OnStart()
+    {
+        Counts.resize(Program.size(), 0);
+        LastStep.resize(Program.size(), 0);
+        Runs++;
+        FirstRepeatPC = -1;
+        CycleLength = 0;
+        PreviousPC = 0;
+    }
+
+    void OnExecute(int PC)
+    {
+        Counts[PC]++;
+        LastStep[PC] = ++Steps;
+
+        if (!RecordTrace) return;
+        int64_t Delta = (int64_t)PC - PreviousPC;
+        uint64_t ZigZag = ((uint64_t)Delta << 1) ^ (uint64_t)(Delta >> 63);
+        while (ZigZag >= 0x80)
+        {
+            Trace.push_back((uint8_t)(ZigZag | 0x80));
+            ZigZag >>= 7;
+        }
+        Trace.push_back((uint8_t)ZigZag);
+        PreviousPC = PC;
+    }
+
+    void OnRepeat(int PC)
+    {
+        FirstRepeatPC = PC;
+        CycleLength = Steps + 1 - LastStep[PC];
+    }
+
+    void WriteTrace(const std::string& Filename) const
+    {
+        std::ofstream ofs(Filename, std::ios::binary);
+        ofs.write((const char*)Trace.data(), Trace.size());
+    }
+
+private:
+    // Step number each instruction last ran at, for the cycle length
+    std::vector<uint64_t> LastStep;
+    int PreviousPC = 0;
+};
+
+template <typename Profiler>
+bool executeProgram(int &OutAccumulator, Profiler& Profile)
 {
     int PC = 0;
-    std::set<int> SeenOpCodes;
+    SeenOpCodes.NextRun(Program.size());
+    Profile.OnStart();
 
     while(true)
     {
-        // check to see if we've executed this OpCode (position) before
-        if (SeenOpCodes.count(PC) == 1) return false;
-        SeenOpCodes.emplace(PC);
-
         // Check to see if we have an invalid jump instruction
         // which makes the program counter beyond the end of the program.
         // In a better emulator we would have some kind of CPU exception here.
@@ -92,10 +201,19 @@ bool executeProgram(int &OutAccumulator)
         // is considered a valid exit. I was expecting for only nop/acc instructions
         // falling off the end by a single instruction to count as graceful exit,
         // but this is not the case.
-        if (PC >= Program.size()) return true;
+        if (PC < 0) throw("Jumped before the start of the program");
+        if (PC >= (int64_t)Program.size()) return true;
+
+        // check to see if we've executed this OpCode (position) before
+        if (SeenOpCodes.TestAndSet(PC))
+        {
+            Profile.OnRepeat(PC);
+            return false;
+        }
+        Profile.OnExecute(PC);
 
         // Retrieve the current instruction from "memory"
-        auto [OpCode, Operand] = Program.at(PC);
+        auto [OpCode, Operand] = Program[PC];
 
         // Jump is the only Opcode that explicitly
         // changes the PC to a different value instead
@@ -121,12 +239,261 @@ bool executeProgram(int &OutAccumulator)
     return true;
 }
 
+bool executeProgram(int &OutAccumulator)
+{
+    NoProfiler Profile;
+    return executeProgram(OutAccumulator, Profile);
+}
+
+// Compact encoding of the program: the opcode in the bottom two bits
+// and the signed operand in the remaining 30, one 32 bit word per
+// instruction, so the whole program sits in a quarter of the memory.
+const int OPCODE_BITS = 2;
+const int OPERAND_LIMIT = 1 << (31 - OPCODE_BITS);
+
+std::vector<uint32_t> compileProgram(const std::vector<std::pair<Op, int>>& Source)
+{
+    std::vector<uint32_t> Bytecode;
+    Bytecode.reserve(Source.size());
+
+    for (const auto& [OpCode, Operand] : Source)
+    {
+        if (Operand >= OPERAND_LIMIT || Operand < -OPERAND_LIMIT) throw("Operand too large to encode");
+        Bytecode.push_back(((uint32_t)Operand << OPCODE_BITS) | (uint32_t)OpCode);
+    }
+
+    return Bytecode;
+}
+
+// Same as executeProgram, but over the compiled bytecode using threaded
+// dispatch: every handler jumps straight to the next handler through a
+// table of label addresses (a GCC/clang extension) rather than going back
+// through a loop and a chain of comparisons.
+bool executeBytecode(const std::vector<uint32_t>& Bytecode, int &OutAccumulator)
+{
+    // indexed by the Op values, so this has to stay in the same order
+    static void* const Handlers[] = {&&Acc, &&Jmp, &&Nop};
+
+    const uint32_t* Code = Bytecode.data();
+    const int64_t Size = Bytecode.size();
+    SeenOpCodes.NextRun(Size);
+    uint32_t* Stamps = SeenOpCodes.Stamps.data();
+    const uint32_t Epoch = SeenOpCodes.Epoch;
+    int64_t PC = 0;
+    int Accumulator = OutAccumulator;
+    bool Terminated = false;
+    uint32_t Instruction;
+    int Operand;
+
+// Leave the program when it falls off the end or starts to repeat itself,
+// otherwise decode the instruction at PC and jump to its handler.
+#define DISPATCH()                                                \
+    if (PC >= Size) { Terminated = true; goto Done; }             \
+    if (PC < 0) throw("Jumped before the start of the program");  \
+    if (Stamps[PC] == Epoch) goto Done;                           \
+    Stamps[PC] = Epoch;                                           \
+    Instruction = Code[PC];                                       \
+    Operand = (int32_t)Instruction >> OPCODE_BITS;                \
+    goto *Handlers[Instruction & ((1 << OPCODE_BITS) - 1)]
+
+    DISPATCH();
+
+Acc:
+    Accumulator += Operand;
+    PC++;
+    DISPATCH();
+
+Jmp:
+    PC += Operand;
+    DISPATCH();
+
+Nop:
+    PC++;
+    DISPATCH();
+
+#undef DISPATCH
+
+Done:
+    OutAccumulator = Accumulator;
+    return Terminated;
+}
+
+// A straight-line run of instructions that can only be entered at the top
+// and only leaves at the bottom. Since acc is the only instruction with a
+// side effect, the whole block boils down to one add and where to go next.
+struct BasicBlock
+{
+    int Start;
+    int AccumulatorDelta;
+
+    // Index of the block that runs next, or one of the two values below.
+    int NextBlock;
+};
+
+const int BLOCK_EXIT = -1;  // ran off the end of the program
+const int BLOCK_CRASH = -2; // jumped before the start of the program
+
+// Split Program into basic blocks. A new block starts at the beginning of
+// the program, at every jump target, and straight after every jmp.
+std::vector<BasicBlock> compileBlocks()
+{
+    const int64_t Size = Program.size();
+
+    std::vector<bool> Leader(Size + 1, false);
+    Leader[0] = true;
+    Leader[Size] = true;
+    for (int PC = 0; PC < Size; PC++)
+    {
+        if (Program[PC].first != Op::Jmp) continue;
+
+        int64_t Target = (int64_t)PC + Program[PC].second;
+        if (Target >= 0 && Target < Size) Leader[Target] = true;
+        Leader[PC + 1] = true;
+    }
+
+    // block index of each leader, for resolving the exits
+    std::vector<int> BlockAt(Size, -1);
+    std::vector<BasicBlock> Blocks;
+    std::vector<int64_t> ExitPCs;
+    for (int Start = 0; Start < Size;)
+    {
+        BlockAt[Start] = Blocks.size();
+
+        int Delta = 0;
+        int PC = Start;
+        int64_t ExitPC = 0;
+        while (true)
+        {
+            auto [OpCode, Operand] = Program[PC];
+            if (OpCode == Op::Acc) Delta += Operand;
+            if (OpCode == Op::Jmp)
+            {
+                ExitPC = (int64_t)PC + Operand;
+                break;
+            }
+            if (Leader[PC + 1])
+            {
+                ExitPC = PC + 1;
+                break;
+            }
+            PC++;
+        }
+
+        Blocks.push_back({Start, Delta, 0});
+        ExitPCs.push_back(ExitPC);
+        Start = PC + 1;
+    }
+
+    for (size_t b = 0; b < Blocks.size(); b++)
+    {
+        if (ExitPCs[b] >= Size) Blocks[b].NextBlock = BLOCK_EXIT;
+        else if (ExitPCs[b] < 0) Blocks[b].NextBlock = BLOCK_CRASH;
+        else Blocks[b].NextBlock = BlockAt[ExitPCs[b]];
+    }
+
+    return Blocks;
+}
+
+// Same as executeProgram, but a block at a time. Blocks can only be entered
+// at their first instruction, so the first instruction to repeat is always
+// the start of a block we've already run, and checking for repeats per
+// block gives exactly the same accumulator as checking per instruction.
+bool executeBlocks(const std::vector<BasicBlock>& Blocks, int &OutAccumulator)
+{
+    SeenStamps Seen;
+    Seen.NextRun(Blocks.size());
+    int Block = 0;
+
+    while (true)
+    {
+        if (Block == BLOCK_EXIT) return true;
+        if (Block == BLOCK_CRASH) throw("Jumped before the start of the program");
+        if (Seen.TestAndSet(Block)) return false;
+
+        OutAccumulator += Blocks[Block].AccumulatorDelta;
+        Block = Blocks[Block].NextBlock;
+    }
+}
+
+// Replace Program with a generated one of the given length. Execution
+// mostly flows forward with short jumps, and the last instruction jumps
+// back to the start, so most of the program runs once before it loops.
+void generateProgram(int Length, uint32_t Seed = 1)
+{
+    std::mt19937 Rng(Seed);
+    Program.clear();
+    NopIndex.clear();
+    JmpIndex.clear();
+
+    for (int PC = 0; PC < Length - 1; PC++)
+    {
+        int Roll = Rng() % 4;
+        if (Roll < 2) Program.push_back({Op::Acc, (int)(Rng() % 201) - 100});
+        if (Roll == 2)
+        {
+            NopIndex.push_back(PC);
+            Program.push_back({Op::Nop, (int)(Rng() % 201) - 100});
+        }
+        if (Roll == 3)
+        {
+            JmpIndex.push_back(PC);
+            Program.push_back({Op::Jmp, 1 + (int)(Rng() % 3)});
+        }
+    }
+
+    JmpIndex.push_back(Program.size());
+    Program.push_back({Op::Jmp, -(Length - 1)});
+}
+
+// Compare instructions per second for the plain loop and the
+// bytecode interpreter on a generated program.
+void benchmarkInterpreters(int Length)
+{
+    generateProgram(Length);
+    std::vector<uint32_t> Bytecode = compileProgram(Program);
+
+    // number of instructions executed before the loop is detected
+    std::vector<bool> Visited(Program.size(), false);
+    int64_t Executed = 0;
+    for (int PC = 0; PC >= 0 && PC < (int64_t)Program.size() && !Visited[PC]; Executed++)
+    {
+        Visited[PC] = true;
+        PC += (Program[PC].first == Op::Jmp) ? Program[PC].second : 1;
+    }
+
+    auto Time = [&](const char* Name, auto Run) {
+        int Accumulator = 0;
+        auto Start = std::chrono::steady_clock::now();
+        Run(Accumulator);
+        double Seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - Start).count();
+        std::cout << Name << ": accumulator " << Accumulator << ", " << Seconds * 1000 << "ms, "
+                  << Executed / Seconds / 1e6 << "M instructions/s" << std::endl;
+    };
+
+    std::cout << Program.size() << " instructions, " << Executed << " executed" << std::endl;
+    Time("executeProgram", [](int& Accumulator) { executeProgram(Accumulator); });
+    Time("executeBytecode", [&](int& Accumulator) { executeBytecode(Bytecode, Accumulator); });
+    Time("compileBlocks + executeBlocks", [](int& Accumulator) { executeBlocks(compileBlocks(), Accumulator); });
+
+    std::vector<BasicBlock> Blocks = compileBlocks();
+    std::cout << Blocks.size() << " basic blocks" << std::endl;
+    Time("executeBlocks", [&](int& Accumulator) { executeBlocks(Blocks, Accumulator); });
+}
+
 // brute-force our way through the nop and jmp indices to find the
 // corrupted instruction.
-int fixCorruption()
+template <typename Profiler>
+int fixCorruption(Profiler& Profile)
 {
     int Accumulator = 0;
 
+    // a flip that jumps before the start of the program is just another
+    // repair that doesn't work, not a reason to give up
+    auto Terminates = [&Accumulator, &Profile]() {
+        try { return executeProgram(Accumulator, Profile); }
+        catch (const char*) { return false; }
+    };
+
     for (int PC : NopIndex)
     {
         // swap the nop for a jmp
@@ -134,7 +501,7 @@ int fixCorruption()
         Program[PC] = {Op::Jmp, Operand};
 
         // test the program and see if it terminates successfully
-        bool terminatedSuccessfully = executeProgram(Accumulator);
+        bool terminatedSuccessfully = Terminates();
         if (terminatedSuccessfully) return Accumulator;
 
         // swap the nop back for the next iteration
@@ -150,7 +517,7 @@ int fixCorruption()
         Program[PC] = {Op::Nop, Operand};
 
         // test the program and see if it terminates successfully
-        bool terminatedSuccessfully = executeProgram(Accumulator);
+        bool terminatedSuccessfully = Terminates();
         if (terminatedSuccessfully) return Accumulator;
 
         // swap the jmp back for the next iteration
@@ -162,14 +529,311 @@ int fixCorruption()
     return -1; // this is not a good signal.
 }
 
+int fixCorruption()
+{
+    NoProfiler Profile;
+    return fixCorruption(Profile);
+}
+
+// Run Program as if the instruction at PatchPC had the opcode PatchOp,
+// without touching Program itself so any number of threads can do this at
+// once, each with their own SeenStamps. Gives up early (returning false)
+// once ShouldStop says so. Jumping before the start of the program also
+// just returns false, since nothing would catch a throw in the threads.
+template <typename StopFn>
+bool executePatched(int PatchPC, Op PatchOp, SeenStamps& Seen, StopFn ShouldStop, int &OutAccumulator)
+{
+    const int64_t Size = Program.size();
+    Seen.NextRun(Size);
+    int64_t PC = 0;
+    int64_t Steps = 0;
+
+    while (true)
+    {
+        if (PC < 0) return false;
+        if (PC >= Size) return true;
+        if (Seen.TestAndSet(PC)) return false;
+
+        // checking on every step would cost more than it saves
+        if ((++Steps & 0xfff) == 0 && ShouldStop()) return false;
+
+        auto [OpCode, Operand] = Program[PC];
+        if (PC == PatchPC) OpCode = PatchOp;
+
+        if (OpCode == Op::Jmp)
+        {
+            PC += Operand;
+            continue;
+        }
+        if (OpCode == Op::Acc) OutAccumulator += Operand;
+        PC++;
+    }
+}
+
+// The same brute force as fixCorruption, with the candidates shared out
+// between threads. Candidates are numbered in the order fixCorruption
+// tries them and the lowest numbered fix wins, so the answer is always
+// the same as the sequential one. Once a fix is found, any thread working
+// on a later candidate abandons it.
+int fixCorruptionParallel()
+{
+    std::vector<std::pair<int, Op>> Candidates;
+    for (int PC : NopIndex) Candidates.push_back({PC, Op::Jmp});
+    for (int PC : JmpIndex) Candidates.push_back({PC, Op::Nop});
+
+    const int NoFix = Candidates.size();
+    std::atomic<int> NextCandidate(0);
+    std::atomic<int> BestCandidate(NoFix);
+    std::vector<int> Accumulators(Candidates.size(), 0);
+
+    auto Worker = [&]() {
+        SeenStamps Seen;
+        while (true)
+        {
+            int Candidate = NextCandidate++;
+            if (Candidate >= BestCandidate) return;
+
+            auto ShouldStop = [&]() { return Candidate > BestCandidate; };
+            const auto& [PC, PatchOp] = Candidates[Candidate];
+            int Accumulator = 0;
+            if (!executePatched(PC, PatchOp, Seen, ShouldStop, Accumulator)) continue;
+            Accumulators[Candidate] = Accumulator;
+
+            // lower the best candidate to ours, unless someone beat us to it
+            int Best = BestCandidate;
+            while (Candidate < Best && !BestCandidate.compare_exchange_weak(Best, Candidate)) {}
+        }
+    };
+
+    std::vector<std::thread> Threads;
+    for (unsigned t = 0; t < std::max(1u, std::thread::hardware_concurrency()); t++) Threads.emplace_back(Worker);
+    for (auto& t : Threads) t.join();
+
+    if (BestCandidate == NoFix) return -1; // this is not a good signal.
+    return Accumulators[BestCandidate];
+}
+
+// Where execution goes after the instruction at PC if it had the given opcode.
+int64_t nextPC(int PC, Op OpCode)
+{
+    return (OpCode == Op::Jmp) ? (int64_t)PC + Program[PC].second : PC + 1;
+}
+
+// Find the corrupted instruction in O(n) rather than by brute force.
+// First work out every instruction that would lead to a clean exit by
+// walking the control flow graph backwards from the end of the program.
+// Then follow the original execution once: the fix is the first nop or
+// jmp on that path whose flipped version lands somewhere that exits.
+// The flipped instruction can't be reached again after the flip, since
+// its original version is part of the loop and so doesn't exit.
+int fixCorruptionLinear()
+{
+    const int Size = Program.size();
+
+    // Predecessors of each instruction, stored compressed: count them,
+    // prefix sum the counts into offsets, then fill.
+    std::vector<int> PredecessorOffsets(Size + 1, 0);
+    for (int PC = 0; PC < Size; PC++)
+    {
+        int64_t Next = nextPC(PC, Program[PC].first);
+        if (Next >= 0 && Next < Size) PredecessorOffsets[Next + 1]++;
+    }
+    for (int PC = 0; PC < Size; PC++) PredecessorOffsets[PC + 1] += PredecessorOffsets[PC];
+
+    std::vector<int> Predecessors(PredecessorOffsets[Size]);
+    std::vector<int> Fill(PredecessorOffsets.begin(), PredecessorOffsets.end() - 1);
+
+    // Instructions that step straight off the end are where the search starts.
+    std::vector<bool> Exits(Size, false);
+    std::vector<int> Queue;
+    for (int PC = 0; PC < Size; PC++)
+    {
+        int64_t Next = nextPC(PC, Program[PC].first);
+        if (Next >= Size)
+        {
+            Exits[PC] = true;
+            Queue.push_back(PC);
+        }
+        else if (Next >= 0) Predecessors[Fill[Next]++] = PC;
+    }
+
+    for (size_t i = 0; i < Queue.size(); i++)
+    {
+        for (int j = PredecessorOffsets[Queue[i]]; j < PredecessorOffsets[Queue[i] + 1]; j++)
+        {
+            int Predecessor = Predecessors[j];
+            if (Exits[Predecessor]) continue;
+            Exits[Predecessor] = true;
+            Queue.push_back(Predecessor);
+        }
+    }
+
+    // Follow the original (looping) execution looking for the flip.
+    SeenOpCodes.NextRun(Size);
+    int64_t PC = 0;
+    while (PC >= 0 && PC < Size && !SeenOpCodes.TestAndSet(PC))
+    {
+        Op OpCode = Program[PC].first;
+        if (OpCode != Op::Acc)
+        {
+            Op Flipped = (OpCode == Op::Jmp) ? Op::Nop : Op::Jmp;
+            int64_t Next = nextPC(PC, Flipped);
+
+            if (Next >= Size || (Next >= 0 && Exits[Next]))
+            {
+                // run the fixed program once to get the accumulator
+                int Accumulator = 0;
+                Program[PC].first = Flipped;
+                executeProgram(Accumulator);
+                Program[PC].first = OpCode;
+                return Accumulator;
+            }
+        }
+        PC = nextPC(PC, OpCode);
+    }
+
+    return -1; // this is not a good signal.
+}
+
+// Replace Program with a generated one that would run cleanly off the end
+// but has had one nop on its path corrupted into a backwards jmp.
+void generateCorruptedProgram(int Length, uint32_t Seed = 1)
+{
+    std::mt19937 Rng(Seed);
+    Program.clear();
+    NopIndex.clear();
+    JmpIndex.clear();
+
+    for (int PC = 0; PC < Length; PC++)
+    {
+        int Roll = Rng() % 4;
+        if (Roll < 2) Program.push_back({Op::Acc, (int)(Rng() % 201) - 100});
+        if (Roll == 2) Program.push_back({Op::Nop, -1 - (int)(Rng() % std::min(PC + 1, 50))});
+        if (Roll == 3) Program.push_back({Op::Jmp, 1 + (int)(Rng() % 3)});
+    }
+
+    // Pick a nop from the second half of the clean execution path
+    std::vector<int> PathNops;
+    for (int64_t PC = 0; PC < Length; PC = nextPC(PC, Program[PC].first))
+    {
+        if (Program[PC].first == Op::Nop && PC > Length / 2) PathNops.push_back(PC);
+    }
+    if (PathNops.empty()) throw("Generated program has nothing to corrupt");
+    Program[PathNops[Rng() % PathNops.size()]].first = Op::Jmp;
+
+    for (int PC = 0; PC < Length; PC++)
+    {
+        if (Program[PC].first == Op::Nop) NopIndex.push_back(PC);
+        if (Program[PC].first == Op::Jmp) JmpIndex.push_back(PC);
+    }
+}
+
+// Time the linear repair on a generated program, and the brute force
+// as well when the program is small enough for it to finish.
+void benchmarkRepair(int Length)
+{
+    generateCorruptedProgram(Length);
+
+    auto ms = [](auto d) { return std::chrono::duration<double, std::milli>(d).count(); };
+    std::cout << Program.size() << " instructions" << std::endl;
+
+    auto Start = std::chrono::steady_clock::now();
+    int Accumulator = fixCorruptionLinear();
+    std::cout << "Linear repair: accumulator " << Accumulator << ", " << ms(std::chrono::steady_clock::now() - Start) << "ms" << std::endl;
+
+    if (Length > 100000) return;
+
+    Start = std::chrono::steady_clock::now();
+    Accumulator = fixCorruptionParallel();
+    std::cout << "Parallel brute force: accumulator " << Accumulator << ", " << ms(std::chrono::steady_clock::now() - Start) << "ms" << std::endl;
+
+    Start = std::chrono::steady_clock::now();
+    Accumulator = fixCorruption();
+    std::cout << "Brute force: accumulator " << Accumulator << ", " << ms(std::chrono::steady_clock::now() - Start) << "ms" << std::endl;
+}
+
+// Print the statistics gathered by a profiler, with the hottest instructions.
+void printProfile(const std::string& Title, const ExecutionProfiler& Profile)
+{
+    std::cout << Title << ": " << Profile.Runs << " runs, " << Profile.Steps << " instructions executed" << std::endl;
+    if (Profile.FirstRepeatPC >= 0)
+    {
+        std::cout << "  Last run first repeated at " << Profile.FirstRepeatPC << ", cycle of " << Profile.CycleLength << " instructions" << std::endl;
+    }
+
+    std::vector<int> Hottest(Profile.Counts.size());
+    std::iota(Hottest.begin(), Hottest.end(), 0);
+    int Shown = std::min<int>(Hottest.size(), 10);
+    std::partial_sort(Hottest.begin(), Hottest.begin() + Shown, Hottest.end(),
+                      [&](int a, int b) { return Profile.Counts[a] > Profile.Counts[b]; });
+
+    const char* Names[] = {"acc", "jmp", "nop"};
+    for (int i = 0; i < Shown; i++)
+    {
+        int PC = Hottest[i];
+        std::cout << "  " << PC << " " << Names[(int)Program[PC].first] << " " << Program[PC].second
+                  << ": " << Profile.Counts[PC] << std::endl;
+    }
+}
+
+// Profile both parts, optionally writing a trace of part 1 to a file.
+void profileProgram(const std::string& TraceFilename)
+{
+    int Accumulator = 0;
+    ExecutionProfiler PartOne;
+    PartOne.RecordTrace = !TraceFilename.empty();
+    executeProgram(Accumulator, PartOne);
+    printProfile("Part 1", PartOne);
+
+    if (PartOne.RecordTrace)
+    {
+        PartOne.WriteTrace(TraceFilename);
+        std::cout << "  Wrote " << PartOne.Trace.size() << " byte trace to " << TraceFilename << std::endl;
+    }
+
+    ExecutionProfiler PartTwo;
+    fixCorruption(PartTwo);
+    printProfile("Part 2 brute force", PartTwo);
+}
+
 int main(int argc, char** argv)
 {
+    if (argc > 1 && std::string(argv[1]) == "--bench")
+    {
+        benchmarkInterpreters(argc > 2 ? std::stoi(argv[2]) : 5000000);
+        return 0;
+    }
+
+    if (argc > 1 && std::string(argv[1]) == "--bench-repair")
+    {
+        benchmarkRepair(argc > 2 ? std::stoi(argv[2]) : 1000000);
+        return 0;
+    }
+
     readInput();
 
+    if (argc > 1 && std::string(argv[1]) == "--profile")
+    {
+        profileProgram(argc > 2 ? argv[2] : "");
+        return 0;
+    }
+
+    // Optionally run part 1 on the basic block version of the program
     int Accumulator = 0;
-    executeProgram(Accumulator);
+    if (argc > 1 && std::string(argv[1]) == "--blocks") executeBlocks(compileBlocks(), Accumulator);
+    else executeProgram(Accumulator);
     std::cout << "Value of the accumulator at point of infinite loop was " << Accumulator << std::endl;
 
-    Accumulator = fixCorruption();
+    // The parallel brute force is an alternative to the linear repair
+    bool Parallel = argc > 1 && std::string(argv[1]) == "--parallel";
+    Accumulator = Parallel ? fixCorruptionParallel() : fixCorruptionLinear();
     std::cout << "Accumulator after fixing bug was " << Accumulator << std::endl;
+
+    // Check the answer against the original brute force search
+    if (argc > 1 && std::string(argv[1]) == "--verify")
+    {
+        int BruteForceAccumulator = fixCorruption();
+        std::cout << "Brute force found " << BruteForceAccumulator << ", "
+                  << (BruteForceAccumulator == Accumulator ? "matches" : "DOES NOT MATCH") << std::endl;
+    }
 }
\ No newline at end of file
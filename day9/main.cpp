@@ -4,25 +4,67 @@
 #include <filesystem>
 #include <vector>
 #include <algorithm>
+#include <unordered_map>
+#include <deque>
+#include <thread>
 
 const std::string INPUT_FILENAME = "input.txt";
-const int RING_BUFFER_SIZE = 25;
+const int DEFAULT_WINDOW_SIZE = 25;
 
 // temporary storage because I don't want to drive everything off readInput.
 // Numbers are definitely bigger than 32 bit.
 std::vector<int64_t> Numbers;
 
-struct Ring
+// The last WindowSize numbers, plus a count of every sum of two different
+// numbers in it. Checking a number is then a single hash lookup, and pushing
+// a new number only has to add and remove the sums involving the numbers
+// coming in and going out, rather than rechecking every pair.
+class XmasWindow
 {
-    int64_t Buffer [RING_BUFFER_SIZE];
-    int Position;
+public:
+    explicit XmasWindow(int WindowSize) : Buffer(WindowSize, 0) {}
 
+    bool Full() const { return Count == Buffer.size(); }
+
+    // A number is valid if it's the sum of two different numbers in the window.
+    bool IsValid(int64_t Num) const { return SumCounts.count(Num) == 1; }
+
+    // Add a number, pushing the oldest one out once the window is full.
     void Push(int64_t Num)
     {
+        if (Full())
+        {
+            int64_t Oldest = Buffer[Position];
+            for (size_t i = 0; i < Buffer.size(); i++)
+            {
+                if (i == Position || Buffer[i] == Oldest) continue;
+
+                auto it = SumCounts.find(Oldest + Buffer[i]);
+                if (--it->second == 0) SumCounts.erase(it);
+            }
+        }
+        else Count++;
+
         Buffer[Position] = Num;
-        Position = (Position+1) % RING_BUFFER_SIZE;
+        for (size_t i = 0; i < Count; i++)
+        {
+            // The slots that haven't been filled yet are at the end, since
+            // we fill from the start before wrapping around.
+            if (i == Position || Buffer[i] == Num) continue;
+            SumCounts[Num + Buffer[i]]++;
+        }
+
+        Position = (Position + 1) % Buffer.size();
     }
-} NumberRing;
+
+private:
+    std::vector<int64_t> Buffer;
+    size_t Position = 0;
+    size_t Count = 0;
+
+    // sum of two different numbers in the window -> how many pairs make it
+    std::unordered_map<int64_t, int> SumCounts;
+};
 
 void readInput()
 {
@@ -43,36 +85,17 @@ void readInput()
     }
 }
 
-// Check through the ring buffer for two numbers
-// that add up to the supplied number. This could 
-// be a lot more efficient and is currently N^2.
-bool numberIsValid(int64_t Num)
+int64_t findFirstInvalidNumber(int WindowSize)
 {
-    // Iterate over the ring buffer to find the first number
-    for (int64_t FirstNum : NumberRing.Buffer)
-    {
-        int64_t RequiredNumber = Num - FirstNum;
-
-        // Iterate again (could use a set here) to see if the
-        // required number to make the sum exists in the buffer.
-        for (int64_t SecondNum : NumberRing.Buffer)
-        {
-            if (SecondNum == RequiredNumber) return true;
-        }
-    }
+    XmasWindow Window(WindowSize);
 
-    return false;
-}
-
-int64_t findFirstInvalidNumber()
-{
     // Get an iterator for convenience in the vector of numbers
     auto it = Numbers.begin();
 
-    // Push the first 25 numbers into the ring buffer
-    for (int i = 0; i < 25; i++)
+    // Push the preamble into the window
+    for (int i = 0; i < WindowSize && it != Numbers.end(); i++)
     {
-        NumberRing.Push(*it);
+        Window.Push(*it);
         it++;
     }
 
@@ -83,11 +106,11 @@ int64_t findFirstInvalidNumber()
 
         // Check the latest number to see whether it is invalid, and
         // if so, return it.
-        if (!numberIsValid(CurrentNumber)) return CurrentNumber;
+        if (!Window.IsValid(CurrentNumber)) return CurrentNumber;
 
-        // If it is valid, it takes the place at the end of the ring
-        // buffer and pushes the oldest one out.
-        NumberRing.Push(CurrentNumber);
+        // If it is valid, it takes the place at the end of the window
+        // and pushes the oldest one out.
+        Window.Push(CurrentNumber);
 
         // Move the iterator to the next number for comparison.
         it++;
@@ -96,70 +119,261 @@ int64_t findFirstInvalidNumber()
     return 0;
 }
 
-void printLowestAndHighestInRange(int Back, int Front)
+// A contiguous range of at least two numbers, [Back, Front] inclusive,
+// along with the lowest and highest numbers within it.
+struct ContiguousRange
 {
-    // This is interesting but I'm not sure if there's a better way.
-    std::vector<int64_t>::const_iterator First = Numbers.begin() + Back;
-    std::vector<int64_t>::const_iterator Last = Numbers.begin() + Front;
-    std::vector<int64_t> Range(First, Last);
+    size_t Back = 0;
+    size_t Front = 0;
+    int64_t Lowest = 0;
+    int64_t Highest = 0;
+};
+
+// Find a contiguous range of at least two numbers that add up to Target.
+// With no negative numbers this is a single sliding window pass: move the
+// front forward, and move the back forward while the sum is too big. The
+// sum is kept up to date as the window moves instead of being recalculated,
+// and the minimum and maximum are tracked with monotonic deques so they're
+// ready as soon as the range is found. Returns false if there isn't one.
+// The range finders take a pointer and length so they can search part of
+// an array in place.
+bool findSlidingRange(const int64_t* Values, size_t Length, int64_t Target, ContiguousRange& OutRange)
+{
+    // Indices of the window's candidates for lowest (values increasing)
+    // and highest (values decreasing), oldest first.
+    std::deque<size_t> Lows, Highs;
+    size_t Back = 0;
+    int64_t Sum = 0;
+
+    for (size_t Front = 0; Front < Length; Front++)
+    {
+        Sum += Values[Front];
+        while (!Lows.empty() && Values[Lows.back()] >= Values[Front]) Lows.pop_back();
+        while (!Highs.empty() && Values[Highs.back()] <= Values[Front]) Highs.pop_back();
+        Lows.push_back(Front);
+        Highs.push_back(Front);
+
+        while (Sum > Target && Back < Front)
+        {
+            Sum -= Values[Back];
+            Back++;
+            if (Lows.front() < Back) Lows.pop_front();
+            if (Highs.front() < Back) Highs.pop_front();
+        }
+
+        if (Sum == Target && Front > Back)
+        {
+            OutRange = {Back, Front, Values[Lows.front()], Values[Highs.front()]};
+            return true;
+        }
+    }
+
+    return false;
+}
+
+// The sliding window only works when adding a number can't make the sum
+// smaller. For anything else, use prefix sums: the range (i, j] adds up to
+// Target when Prefix[j] - Prefix[i] == Target, so remember where each
+// prefix sum was first seen and look for Prefix[j] - Target.
+bool findPrefixSumRange(const int64_t* Values, size_t Length, int64_t Target, ContiguousRange& OutRange)
+{
+    std::unordered_map<int64_t, size_t> FirstPrefix;
+    int64_t Prefix = 0;       // sum of Values[0..j]
+    int64_t LaggedPrefix = 0; // sum of Values[0..j-2], so ranges have two numbers
+
+    for (size_t j = 0; j < Length; j++)
+    {
+        if (j >= 1)
+        {
+            // prefix of the first j-1 numbers becomes available as a start
+            FirstPrefix.try_emplace(LaggedPrefix, j - 1);
+            LaggedPrefix += Values[j - 1];
+        }
+        Prefix += Values[j];
+
+        auto it = FirstPrefix.find(Prefix - Target);
+        if (it == FirstPrefix.end()) continue;
 
-    std::sort(Range.begin(), Range.end());
+        OutRange.Back = it->second;
+        OutRange.Front = j;
+        auto [Lowest, Highest] = std::minmax_element(Values + OutRange.Back, Values + j + 1);
+        OutRange.Lowest = *Lowest;
+        OutRange.Highest = *Highest;
+        return true;
+    }
+
+    return false;
+}
 
-    std::cout << "Encryption weakness sum is " << Range.front() << " + " << Range.back() << " = " << Range.front() + Range.back() << std::endl;
+bool findContiguousRange(const int64_t* Values, size_t Length, int64_t Target, ContiguousRange& OutRange)
+{
+    bool AllPositive = std::all_of(Values, Values + Length, [](int64_t v) { return v >= 0; });
+    if (AllPositive) return findSlidingRange(Values, Length, Target, OutRange);
+    return findPrefixSumRange(Values, Length, Target, OutRange);
 }
 
 // Find the contiguous range of numbers in the original number list
-// that add up to the invalid number. I think this can be done by
-// having a moving range over the vector, moving the front of the
-// range until the sum is greater than the number, and then moving
-// the back of the range until the sum is less than the number.
+// that add up to the invalid number, and output the lowest and highest
+// numbers in it.
 void findInvalidNumberComponents(int64_t InvalidNum)
 {
-    int Front = 1; // has to be at least two numbers
-    int Back = 0;
+    ContiguousRange Range;
+    if (!findContiguousRange(Numbers.data(), Numbers.size(), InvalidNum, Range))
+    {
+        std::cout << "No contiguous range adds up to " << InvalidNum << std::endl;
+        return;
+    }
+
+    std::cout << "Encryption weakness sum is " << Range.Lowest << " + " << Range.Highest << " = " << Range.Lowest + Range.Highest << std::endl;
+}
+
+// Validate an unbounded feed of numbers from stdin, one per line, using
+// only the last WindowSize numbers. Every invalid number is reported as
+// soon as it arrives. If HistorySize is non-zero, that many of the most
+// recent numbers are also kept so that part 2 can be run against them for
+// each invalid number. Memory use is bounded by the two sizes either way.
+void streamNumbers(int WindowSize, size_t HistorySize)
+{
+    XmasWindow Window(WindowSize);
+    std::deque<int64_t> History;
+    uint64_t Position = 0;
+    uint64_t InvalidCount = 0;
 
-    // Loop until the front of the range goes over the end of the vector
-    while (Front < Numbers.size())
+    std::string Line;
+    while (std::getline(std::cin, Line))
     {
-        // Sum the range of numbers
-        int64_t Sum = 0;
-        for (int i = Back; i <= Front; i++)
+        if (Line.empty()) continue;
+        int64_t Num = std::stoll(Line);
+
+        if (Window.Full() && !Window.IsValid(Num))
+        {
+            InvalidCount++;
+            std::cout << "Invalid number " << Num << " at position " << Position << std::endl;
+
+            ContiguousRange Range;
+            std::vector<int64_t> Recent(History.begin(), History.end());
+            if (HistorySize > 0 && findContiguousRange(Recent.data(), Recent.size(), Num, Range))
+            {
+                uint64_t First = Position - History.size();
+                std::cout << "  Positions " << First + Range.Back << " to " << First + Range.Front << " add up to it, weakness "
+                          << Range.Lowest << " + " << Range.Highest << " = " << Range.Lowest + Range.Highest << std::endl;
+            }
+        }
+
+        // Invalid numbers still count towards the window for later numbers
+        Window.Push(Num);
+        if (HistorySize > 0)
         {
-            Sum += Numbers[i];
+            History.push_back(Num);
+            if (History.size() > HistorySize) History.pop_front();
         }
+        Position++;
+    }
+
+    std::cout << Position << " numbers read, " << InvalidCount << " invalid." << std::endl;
+}
+
+// Find every invalid number in Numbers, and the contiguous range that adds
+// up to each one, using all available threads. A number's validity only
+// depends on the WindowSize numbers before it, so each thread takes a chunk
+// of positions and first fills its own window from the numbers just before
+// the chunk. The range searches are independent as well, so they're shared
+// out the same way. Results are printed in input order.
+void scanAllInvalidParallel(int WindowSize)
+{
+    const size_t Count = Numbers.size();
+    const size_t WindowLength = WindowSize; // checked to be at least 2 already
+    const size_t ThreadCount = std::max(1u, std::thread::hardware_concurrency());
 
-        // If the Sum is lower than the InvalidNum, the front should be
-        // moved one place forward.
-        if (Sum < InvalidNum)
+    auto RunOnThreads = [&](size_t Items, auto Work) {
+        std::vector<std::thread> Threads;
+        size_t PerThread = (Items + ThreadCount - 1) / ThreadCount;
+        for (size_t t = 0; t < ThreadCount; t++)
         {
-            Front++;
-            continue;
+            size_t First = std::min(t * PerThread, Items);
+            size_t Last = std::min(First + PerThread, Items);
+            Threads.emplace_back(Work, t, First, Last);
         }
+        for (auto& Thread : Threads) Thread.join();
+    };
+
+    // Invalid positions found by each thread, in order
+    std::vector<std::vector<size_t>> ThreadInvalid(ThreadCount);
+    size_t Checked = (Count > WindowLength) ? Count - WindowLength : 0;
+    RunOnThreads(Checked, [&](size_t t, size_t First, size_t Last) {
+        // nothing to check, and no numbers to fill the window with either
+        if (First == Last) return;
+
+        XmasWindow Window(WindowSize);
+        for (size_t i = First; i < First + WindowLength; i++) Window.Push(Numbers[i]);
 
-        // If the Sum is higher than the InvalidNum, the back should be
-        // moved one place forward. Although this seems intuitive if the
-        // list of numbers is sorted in ascending order, it is not. Although,
-        // the trend is increasing, so it feels right.
-        if (Sum > InvalidNum)
+        for (size_t i = First + WindowLength; i < Last + WindowLength; i++)
         {
-            Back++;
-            continue;
+            if (!Window.IsValid(Numbers[i])) ThreadInvalid[t].push_back(i);
+            Window.Push(Numbers[i]);
         }
+    });
+
+    std::vector<size_t> Invalid;
+    for (const auto& Positions : ThreadInvalid) Invalid.insert(Invalid.end(), Positions.begin(), Positions.end());
 
-        // If the Sum is equal to the InvalidNum, we've got the right range.
-        // Sort it, and output the lowest and highest numbers in the range.
-        if (Sum == InvalidNum)
+    std::vector<ContiguousRange> Ranges(Invalid.size());
+    std::vector<char> Found(Invalid.size(), 0);
+    // Like the streaming mode, only search the numbers that came before each
+    // invalid one, so the answers are the same as --stream with enough
+    // history to cover the whole input.
+    RunOnThreads(Invalid.size(), [&](size_t, size_t First, size_t Last) {
+        for (size_t i = First; i < Last; i++)
         {
-            printLowestAndHighestInRange(Back, Front);
-            return;
+            Found[i] = findContiguousRange(Numbers.data(), Invalid[i], Numbers[Invalid[i]], Ranges[i]);
         }
+    });
+
+    for (size_t i = 0; i < Invalid.size(); i++)
+    {
+        std::cout << "Invalid number " << Numbers[Invalid[i]] << " at position " << Invalid[i] << std::endl;
+        if (!Found[i]) continue;
+
+        const auto& Range = Ranges[i];
+        std::cout << "  Positions " << Range.Back << " to " << Range.Front << " add up to it, weakness "
+                  << Range.Lowest << " + " << Range.Highest << " = " << Range.Lowest + Range.Highest << std::endl;
     }
+    std::cout << Count << " numbers read, " << Invalid.size() << " invalid." << std::endl;
+}
+
+// Window size from the command line, or the default. A number has to be
+// the sum of two different numbers, so anything smaller than 2 can't work.
+int parseWindowSize(int argc, char** argv, int Index)
+{
+    int WindowSize = (argc > Index) ? std::stoi(argv[Index]) : DEFAULT_WINDOW_SIZE;
+    if (WindowSize < 2) throw("Window size must be at least 2");
+    return WindowSize;
 }
 
 int main(int argc, char** argv)
 {
+    // Streaming mode: --stream [window size] [history size]
+    if (argc > 1 && std::string(argv[1]) == "--stream")
+    {
+        int StreamWindow = parseWindowSize(argc, argv, 2);
+        size_t HistorySize = (argc > 3) ? std::stoul(argv[3]) : 0;
+        streamNumbers(StreamWindow, HistorySize);
+        return 0;
+    }
+
+    // Parallel scan for all invalid numbers: --parallel [window size]
+    if (argc > 1 && std::string(argv[1]) == "--parallel")
+    {
+        readInput();
+        scanAllInvalidParallel(parseWindowSize(argc, argv, 2));
+        return 0;
+    }
+
+    // The window (preamble) size can be given on the command line
+    int WindowSize = parseWindowSize(argc, argv, 1);
+
     readInput();
-    int64_t InvalidNum = findFirstInvalidNumber();
+    int64_t InvalidNum = findFirstInvalidNumber(WindowSize);
     std::cout << "First invalid number is " << InvalidNum << std::endl;
 
     findInvalidNumberComponents(InvalidNum);